@@ -0,0 +1,272 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Time it takes to load all frames of a long GIF animation, once frame by
+ * frame through imlib_load_image_frame() like nsxiv did before, once in a
+ * single pass with gif.c.
+ *
+ * usage: anim_load [-n frames] [-s WxH] [FILE]
+ * Without FILE an animation with a full keyframe every 50 frames and small
+ * moving deltas in between is generated.
+ */
+
+#include "gif.h"
+#include "cli_options.h"
+#include "util.h"
+
+#include "bench.h"
+
+#include <Imlib2.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum { DELTA_SIZE = 48, KEYFRAME_INTERVAL = 50 };
+
+opt_t *g_options = &(opt_t){ .quiet = true };
+
+typedef struct {
+    int (*load)(const char *path);
+    const char *path;
+    int frames; /* loaded by the last run */
+} job_t;
+
+
+/* GIF writer {{{ */
+
+typedef struct {
+    FILE *f;
+    unsigned char block[255];
+    int len;
+    uint32_t bits;
+    int nbits;
+} bitwriter_t;
+
+static void put_u16(FILE *f, int v)
+{
+    fputc(v & 0xFF, f);
+    fputc(v >> 8, f);
+}
+
+static void put_code(bitwriter_t *bw, int code, int size)
+{
+    bw->bits |= (uint32_t)code << bw->nbits;
+    for (bw->nbits += size; bw->nbits >= 8; bw->nbits -= 8, bw->bits >>= 8) {
+        bw->block[bw->len++] = bw->bits & 0xFF;
+        if (bw->len == 255) {
+            fputc(255, bw->f);
+            fwrite(bw->block, 1, 255, bw->f);
+            bw->len = 0;
+        }
+    }
+}
+
+/* LZW with 8 bit indices, the table starts over once it is full */
+static void put_lzw(FILE *f, const unsigned char *idx, size_t n)
+{
+    static uint16_t dict[4096][256];
+    enum { MIN = 8, CLEAR = 1 << MIN, EOI = CLEAR + 1 };
+    bitwriter_t bw = { .f = f };
+    int size = MIN + 1, avail = EOI + 1, cur;
+
+    fputc(MIN, f);
+    memset(dict, 0, sizeof(dict));
+    put_code(&bw, CLEAR, size);
+    cur = idx[0];
+    for (size_t i = 1; i < n; i++) {
+        if (dict[cur][idx[i]] != 0) {
+            cur = dict[cur][idx[i]];
+            continue;
+        }
+        put_code(&bw, cur, size);
+        if (avail < 4096) {
+            dict[cur][idx[i]] = avail;
+            if (avail++ == 1 << size)
+                size++;
+        } else {
+            put_code(&bw, CLEAR, size);
+            memset(dict, 0, sizeof(dict));
+            size = MIN + 1;
+            avail = EOI + 1;
+        }
+        cur = idx[i];
+    }
+    put_code(&bw, cur, size);
+    put_code(&bw, EOI, size);
+    put_code(&bw, 0, 7); /* flush */
+    if (bw.len > 0) {
+        fputc(bw.len, f);
+        fwrite(bw.block, 1, bw.len, f);
+    }
+    fputc(0, f);
+}
+
+static void put_frame(FILE *f, const unsigned char *idx, int x, int y, int w, int h)
+{
+    fputc(0x21, f); /* graphic control extension, 40ms */
+    fputc(0xF9, f);
+    fputc(4, f);
+    fputc(0, f);
+    put_u16(f, 4);
+    fputc(0, f);
+    fputc(0, f);
+    fputc(0x2C, f);
+    put_u16(f, x);
+    put_u16(f, y);
+    put_u16(f, w);
+    put_u16(f, h);
+    fputc(0, f);
+    put_lzw(f, idx, (size_t)w * h);
+}
+
+static void write_gif(const char *path, int nframes, int w, int h)
+{
+    FILE *f = fopen(path, "wb");
+    unsigned char *idx = emalloc((size_t)w * h);
+
+    if (f == NULL)
+        error_quit(EXIT_FAILURE, 0, "%s: cannot create", path);
+    fwrite("GIF89a", 1, 6, f);
+    put_u16(f, w);
+    put_u16(f, h);
+    fputc(0xF7, f); /* 256 color global palette */
+    fputc(0, f);
+    fputc(0, f);
+    for (int i = 0; i < 256; i++) {
+        fputc(i, f);
+        fputc(i * 7 & 0xFF, f);
+        fputc(255 - i, f);
+    }
+    for (int n = 0; n < nframes; n++) {
+        if (n % KEYFRAME_INTERVAL == 0) {
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++)
+                    idx[y * w + x] = (x / 8 + y / 8 + n) & 0xFF;
+            }
+            put_frame(f, idx, 0, 0, w, h);
+        } else {
+            int dw = MIN(DELTA_SIZE, w), dh = MIN(DELTA_SIZE, h);
+            int x = n * 7 % (w - dw + 1), y = n * 5 % (h - dh + 1);
+            for (int i = 0; i < dw * dh; i++)
+                idx[i] = (i + n) & 0xFF;
+            put_frame(f, idx, x, y, dw, dh);
+        }
+    }
+    fputc(0x3B, f);
+    free(idx);
+    if (fclose(f) != 0)
+        error_quit(EXIT_FAILURE, 0, "%s: write error", path);
+}
+
+/* }}} */
+
+
+static int load_imlib(const char *path)
+{
+    Imlib_Image im;
+    Imlib_Frame_Info finfo;
+    int n = 1, cnt = 1;
+
+    do {
+        if ((im = imlib_load_image_frame(path, n)) == NULL)
+            break;
+        imlib_context_set_image(im);
+        imlib_image_get_frame_info(&finfo);
+        cnt = finfo.frame_count;
+        imlib_free_image_and_decache();
+    } while (++n <= cnt);
+    return n - 1;
+}
+
+
+static int load_single_pass(const char *path)
+{
+    gif_t *g = gif_open(path);
+    gif_frame_t f;
+    int n = 0;
+
+    if (g == NULL)
+        return 0;
+    while (gif_next_frame(g, &f)) {
+        Imlib_Image im = imlib_create_image_using_copied_data(f.w, f.h, f.pixels);
+        if (im == NULL)
+            break;
+        imlib_context_set_image(im);
+        imlib_free_image();
+        n++;
+    }
+    gif_close(g);
+    return n;
+}
+
+
+static void run_load(void *arg)
+{
+    job_t *job = arg;
+
+    job->frames = job->load(job->path);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int opt, nframes = 600, w = 320, h = 240, n1;
+    job_t job = { .path = NULL };
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nframes = MAX(1, atoi(optarg));
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0 || w > 0xFFFF || h > 0xFFFF)
+                error_quit(EXIT_FAILURE, 0, "invalid size: %s", optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames] [-s WxH] [FILE]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        job.path = argv[optind];
+    } else {
+        size_t len = strlen(bench_tmpdir()) + sizeof("/anim.gif");
+        char *tmp = emalloc(len);
+
+        snprintf(tmp, len, "%s/anim.gif", bench_tmpdir());
+        write_gif(tmp, nframes, w, h);
+        job.path = tmp;
+    }
+
+    printf("loading all frames of %s:\n", job.path);
+    job.load = load_imlib;
+    bench_run("imlib_load_image_frame()", run_load, &job, BENCH_WARMUP, BENCH_REPEAT);
+    n1 = job.frames;
+    job.load = load_single_pass;
+    bench_run("single pass with gif.c", run_load, &job, BENCH_WARMUP, BENCH_REPEAT);
+    if (n1 != job.frames)
+        error_quit(EXIT_FAILURE, 0, "%s: %d frames loaded by imlib, %d in a single pass",
+                   job.path, n1, job.frames);
+
+    if (optind >= argc)
+        free((char *)job.path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <Imlib2.h>
+#include <errno.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static char tmpdir[] = "/tmp/nsxiv-bench-XXXXXX";
+static bool tmpdir_made;
+
+
+double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int dblcmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+/* calls fn warmup times, then reports the median and p95 of repeat calls */
+void bench_run(const char *name, bench_f fn, void *arg, int warmup, int repeat)
+{
+    double *t;
+
+    repeat = MAX(repeat, 1);
+    t = emalloc(repeat * sizeof(*t));
+    for (int i = 0; i < warmup; i++)
+        fn(arg);
+    for (int i = 0; i < repeat; i++) {
+        t[i] = bench_now();
+        fn(arg);
+        t[i] = bench_now() - t[i];
+    }
+    qsort(t, repeat, sizeof(*t), dblcmp);
+    printf("  %-36s %4d runs  median %10.3f ms  p95 %10.3f ms\n", name, repeat,
+           t[repeat / 2] * 1e3, t[(repeat * 95 + 99) / 100 - 1] * 1e3);
+    free(t);
+}
+
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    remove(path);
+    return 0;
+}
+
+
+static void remove_tmpdir(void)
+{
+    nftw(tmpdir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+/* scratch directory for the corpus, removed again at exit */
+const char *bench_tmpdir(void)
+{
+    if (!tmpdir_made) {
+        if (mkdtemp(tmpdir) == NULL)
+            error_quit(EXIT_FAILURE, 0, "%s: cannot create", tmpdir);
+        tmpdir_made = true;
+        atexit(remove_tmpdir);
+    }
+    return tmpdir;
+}
+
+
+/*
+ * Writes a w x h image with smooth gradients and some detail to name in the
+ * scratch directory, in the format of its extension. Returns its path.
+ */
+char *bench_image(const char *name, int w, int h, bool alpha)
+{
+    size_t len = strlen(bench_tmpdir()) + strlen(name) + 2;
+    char *path = emalloc(len);
+    Imlib_Image im;
+    Imlib_Load_Error err;
+    uint32_t *data;
+
+    snprintf(path, len, "%s/%s", bench_tmpdir(), name);
+    if ((im = imlib_create_image(w, h)) == NULL)
+        error_quit(EXIT_FAILURE, ENOMEM, NULL);
+    imlib_context_set_image(im);
+    imlib_image_set_has_alpha(alpha);
+    data = imlib_image_get_data();
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t a = alpha ? (uint32_t)(x + y) * 255 / (w + h) : 0xFF;
+            uint32_t r = x * 255 / w, g = y * 255 / h, b = (x ^ y) & 0xFF;
+            data[(size_t)y * w + x] = a << 24 | r << 16 | g << 8 | b;
+        }
+    }
+    imlib_image_put_back_data(data);
+    imlib_save_image_with_error_return(path, &err);
+    imlib_free_image();
+    if (err)
+        error_quit(EXIT_FAILURE, 0, "%s: cannot save image", path);
+    return path;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+
+/*
+ * Helpers shared by the benchmarks: every measurement is preceded by warm-up
+ * runs and reported as the median and the 95th percentile of its repetitions.
+ */
+typedef void (*bench_f)(void *arg);
+
+enum {
+    BENCH_WARMUP = 3,
+    BENCH_REPEAT = 25
+};
+
+
+// bench.c {{{
+double bench_now(void);
+void bench_run(const char *name, bench_f, void *arg, int warmup, int repeat)
+    __attribute__((nonnull (1, 2)));
+const char* bench_tmpdir(void);
+char* bench_image(const char *name, int w, int h, bool alpha)
+    __attribute__((nonnull (1)));
+// }}}
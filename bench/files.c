@@ -0,0 +1,177 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Building the file list: recursive dirwalk() over synthetic directory trees
+ * and filesort() of a large list of names, with and without natural order.
+ *
+ * usage: files [-n names]
+ */
+
+#include "cli_options.h"
+#include "dirwalk.h"
+#include "filesort.h"
+#include "util.h"
+
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+opt_t *g_options = &(opt_t){ .quiet = true };
+
+typedef struct {
+    const char *root;
+    int filecnt;
+} walk_job_t;
+
+typedef struct {
+    const fileinfo_t *names;
+    fileinfo_t *files;
+    int cnt;
+    bool natural;
+} sort_job_t;
+
+
+static void run_walk(void *arg)
+{
+    const walk_job_t *job = arg;
+    dirwalk_t walk;
+
+    if (dirwalk(&walk, job->root, true, true) < 0)
+        error_quit(EXIT_FAILURE, errno, "%s", job->root);
+    if (walk.filecnt != job->filecnt)
+        error_quit(EXIT_FAILURE, 0, "%s: %d files found, %d expected",
+                   job->root, walk.filecnt, job->filecnt);
+    dirwalk_free(&walk);
+}
+
+
+/* filesort() sorts in place, so every run starts from the unsorted copy */
+static void run_sort(void *arg)
+{
+    const sort_job_t *job = arg;
+
+    memcpy(job->files, job->names, job->cnt * sizeof(*job->files));
+    filesort(job->files, job->cnt, job->natural);
+}
+
+
+/* dirs directories below root, nested up to three deep, files empty files each */
+static char *make_tree(const char *name, int dirs, int files)
+{
+    size_t len = strlen(bench_tmpdir()) + strlen(name) + 64;
+    char *root = emalloc(len), *path = emalloc(len);
+    int fd;
+
+    snprintf(root, len, "%s/%s", bench_tmpdir(), name);
+    if (mkdir(root, 0755) < 0)
+        error_quit(EXIT_FAILURE, errno, "%s", root);
+    for (int d = 0; d < dirs; d++) {
+        if (d < 8)
+            snprintf(path, len, "%s/d%d", root, d);
+        else if (d < 64)
+            snprintf(path, len, "%s/d%d/d%d", root, d % 8, d);
+        else
+            snprintf(path, len, "%s/d%d/d%d/d%d", root, d % 8, 8 + d % 56, d);
+        if (mkdir(path, 0755) < 0)
+            error_quit(EXIT_FAILURE, errno, "%s", path);
+        for (int f = 0; f < files; f++) {
+            snprintf(path + strlen(path), len - strlen(path), "/IMG_%04d.jpg", f);
+            if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+                error_quit(EXIT_FAILURE, errno, "%s", path);
+            close(fd);
+            *strrchr(path, '/') = '\0';
+        }
+    }
+    free(path);
+    return root;
+}
+
+
+/* names like a photo collection would have them, with numbers to compare */
+static fileinfo_t *make_names(int cnt)
+{
+    static const char *const prefixes[] = { "IMG_", "DSC", "Screenshot ", "scan-", "" };
+    fileinfo_t *names = emalloc(cnt * sizeof(*names));
+    char buf[64];
+
+    srand(1);
+    for (int i = 0; i < cnt; i++) {
+        snprintf(buf, sizeof(buf), "/home/user/Pictures/%s%d_%d.jpg",
+                 prefixes[rand() % ARRLEN(prefixes)], rand() % 10000, rand() % 100);
+        names[i].name = names[i].path = estrdup(buf);
+        names[i].flags = 0;
+    }
+    return names;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const struct { int dirs, files; } trees[] = {
+        { 1, 10000 }, { 100, 100 }, { 1000, 10 }
+    };
+    int opt, namecnt = 100000;
+    char name[64], *root;
+    walk_job_t walk;
+    sort_job_t sort;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            if ((namecnt = atoi(optarg)) <= 0)
+                error_quit(EXIT_FAILURE, 0, "invalid number of names: %s", optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n names]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    setlocale(LC_COLLATE, "");
+
+    printf("recursive dirwalk():\n");
+    for (unsigned int i = 0; i < ARRLEN(trees); i++) {
+        snprintf(name, sizeof(name), "tree%u", i);
+        walk.root = root = make_tree(name, trees[i].dirs, trees[i].files);
+        walk.filecnt = trees[i].dirs * trees[i].files;
+        snprintf(name, sizeof(name), "%d dirs x %d files", trees[i].dirs, trees[i].files);
+        bench_run(name, run_walk, &walk, BENCH_WARMUP, BENCH_REPEAT);
+        free(root);
+    }
+
+    printf("filesort() of %d names:\n", namecnt);
+    sort.cnt = namecnt;
+    sort.names = make_names(namecnt);
+    sort.files = emalloc(namecnt * sizeof(*sort.files));
+    sort.natural = false;
+    bench_run("plain", run_sort, &sort, BENCH_WARMUP, BENCH_REPEAT);
+    sort.natural = true;
+    bench_run("natural", run_sort, &sort, BENCH_WARMUP, BENCH_REPEAT);
+    for (int i = 0; i < namecnt; i++)
+        free((char *)sort.names[i].name);
+    free((fileinfo_t *)sort.names);
+    free(sort.files);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Full redraws by img_render() of a transparent image onto the checkerboard
+ * alpha layer and onto the window background, and of an opaque image for
+ * comparison, also with gamma, brightness and contrast adjusted, each fit into
+ * the window and at 100%.
+ *
+ * usage: render [-s WxH]
+ * It needs an X display to render to and is skipped without one.
+ */
+
+#include "image.h"
+#include "cli_options.h"
+#include "util.h"
+#include "window.h"
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+opt_t *g_options = &(opt_t){ .quiet = true, .zoom = 1.0, .anti_alias = true };
+fileinfo_t *g_files;
+int g_filecnt, g_fileidx;
+
+
+static void run_render(void *arg)
+{
+    SxivImage *img = arg;
+
+    /* nothing of the previous run may be reused */
+    img->drawn.src = NULL;
+    img->flags |= IF_IS_DIRTY;
+    img_render(img);
+    XSync(img->win->env.dpy, False);
+}
+
+
+static void bench_file(SxivImage *img, const char *label, const char *path, bool checker)
+{
+    fileinfo_t file = { .name = path, .path = path };
+    const scalemode_t modes[] = { SCALE_FIT, SCALE_ZOOM };
+    char name[64];
+
+    if (!img_load(img, &file))
+        error_quit(EXIT_FAILURE, 0, "%s: cannot load", path);
+    img->flags = (img->flags & ~IF_HAS_ALPHA_LAYER) | (checker ? IF_HAS_ALPHA_LAYER : 0);
+    for (unsigned int i = 0; i < ARRLEN(modes); i++) {
+        img->scalemode = modes[i];
+        img->zoom = 1.0;
+        img->flags |= IF_CHECKPAN;
+        snprintf(name, sizeof(name), "%s, %s", label, modes[i] == SCALE_FIT ? "fit" : "100%");
+        bench_run(name, run_render, img, BENCH_WARMUP, BENCH_REPEAT);
+    }
+    img_close(img, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int opt, w = 1920, h = 1080;
+    char *opaque, *alpha;
+    win_t win;
+    SxivImage img;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's':
+            if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+                error_quit(EXIT_FAILURE, 0, "invalid size: %s", optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s WxH]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (getenv("DISPLAY") == NULL || *getenv("DISPLAY") == '\0') {
+        printf("img_render(): skipped, no X display\n");
+        return EXIT_SUCCESS;
+    }
+    opaque = bench_image("opaque.png", w, h, false);
+    alpha = bench_image("alpha.png", w, h, true);
+
+    win_init(&win);
+    win_open(&win);
+    img_init(&img, &win);
+    printf("img_render() of a %dx%d image into %ux%u:\n", w, h, win.w, win.h);
+    bench_file(&img, "transparent on checkerboard", alpha, true);
+    bench_file(&img, "transparent on background", alpha, false);
+    bench_file(&img, "opaque", opaque, false);
+    img_change_color_modifier(&img, 4, &img.gamma);
+    img_change_color_modifier(&img, 2, &img.brightness);
+    img_change_color_modifier(&img, 3, &img.contrast);
+    bench_file(&img, "opaque, color adjusted", opaque, false);
+    win_close(&win);
+
+    free(opaque);
+    free(alpha);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Thumbnail hot paths: tns_scale_down() to every size of thumb_sizes[], cache
+ * round trips through tns_cache_write() and tns_cache_load(), and the
+ * apply_filters() of marked thumbnails.
+ *
+ * usage: thumbs [-s WxH]
+ * thumbs.c is included rather than linked, for its static functions.
+ */
+
+#include "../src/thumbs.c"
+
+#include "bench.h"
+
+opt_t *g_options = &(opt_t){ .quiet = true, .anti_alias = true };
+fileinfo_t *g_files;
+int g_filecnt, g_fileidx;
+
+typedef struct {
+    Imlib_Image src;
+    int size;
+    const char *path;
+} job_t;
+
+
+static void run_clone(void *arg)
+{
+    const job_t *job = arg;
+
+    imlib_context_set_image(job->src);
+    imlib_context_set_image(imlib_clone_image());
+    imlib_free_image();
+}
+
+
+/* tns_scale_down() frees its argument, so it gets a copy */
+static void run_scale(void *arg)
+{
+    const job_t *job = arg;
+    Imlib_Image im;
+
+    imlib_context_set_image(job->src);
+    im = tns_scale_down(imlib_clone_image(), job->size);
+    imlib_context_set_image(im);
+    imlib_free_image();
+}
+
+
+static void run_cache(void *arg)
+{
+    const job_t *job = arg;
+    bool outdated = false;
+    Imlib_Image im;
+
+    tns_cache_write(job->src, job->path, true);
+    if ((im = tns_cache_load(job->path, &outdated)) == NULL)
+        error_quit(EXIT_FAILURE, 0, "%s: not in the cache", job->path);
+    imlib_context_set_image(im);
+    imlib_free_image_and_decache();
+}
+
+
+static void run_filters(void *arg)
+{
+    const job_t *job = arg;
+    ThumbnailState tns = { .mark_cm = emalloc(sizeof(*tns.mark_cm)) };
+
+    for (int i = 255; i >= 0; i--)
+        tns.mark_cm->a[i] = tns.mark_cm->r[i] = tns.mark_cm->g[i] = tns.mark_cm->b[i] = i;
+    transform_mark_color_modifier(&tns);
+    imlib_context_set_image(apply_filters(job->src, tns.mark_cm));
+    imlib_free_image();
+    free(tns.mark_cm);
+}
+
+
+/* the image file at path, scaled down like tns_load() does before caching */
+static Imlib_Image load_thumb(const char *path)
+{
+    Imlib_Image im;
+
+    if ((im = imlib_load_image_immediately(path)) == NULL)
+        error_quit(EXIT_FAILURE, 0, "%s: cannot load", path);
+    return tns_scale_down(im, thumb_sizes[ARRLEN(thumb_sizes) - 1]);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int opt, w = 1920, h = 1080;
+    char name[64], *opaque, *alpha;
+    job_t job;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's':
+            if (sscanf(optarg, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+                error_quit(EXIT_FAILURE, 0, "invalid size: %s", optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s WxH]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    setenv("XDG_CACHE_HOME", bench_tmpdir(), 1);
+    if (!tns_cache_init())
+        error_quit(EXIT_FAILURE, 0, "Cache directory not found");
+    opaque = bench_image("opaque.png", w, h, false);
+    alpha = bench_image("alpha.png", w, h, true);
+
+    printf("tns_scale_down() of a %dx%d image:\n", w, h);
+    if ((job.src = imlib_load_image_immediately(opaque)) == NULL)
+        error_quit(EXIT_FAILURE, 0, "%s: cannot load", opaque);
+    bench_run("imlib_clone_image() alone", run_clone, &job, BENCH_WARMUP, BENCH_REPEAT);
+    for (unsigned int i = 0; i < ARRLEN(thumb_sizes); i++) {
+        job.size = thumb_sizes[i];
+        snprintf(name, sizeof(name), "clone + scale to %d", job.size);
+        bench_run(name, run_scale, &job, BENCH_WARMUP, BENCH_REPEAT);
+    }
+    imlib_context_set_image(job.src);
+    imlib_free_image_and_decache();
+
+    printf("thumbnail cache, tns_cache_write() + tns_cache_load():\n");
+    job.path = alpha;
+    job.src = load_thumb(alpha);
+    bench_run("transparent (png)", run_cache, &job, BENCH_WARMUP, BENCH_REPEAT);
+    imlib_context_set_image(job.src);
+    imlib_free_image();
+    job.path = opaque;
+    job.src = load_thumb(opaque);
+    bench_run("opaque (jpg)", run_cache, &job, BENCH_WARMUP, BENCH_REPEAT);
+
+    printf("apply_filters() of a marked thumbnail:\n");
+    bench_run("opaque", run_filters, &job, BENCH_WARMUP, BENCH_REPEAT);
+    imlib_context_set_image(job.src);
+    imlib_free_image();
+
+    free(opaque);
+    free(alpha);
+    return EXIT_SUCCESS;
+}
@@ -57,6 +57,46 @@ static const int CACHE_SIZE_MEM_PERCENTAGE = 3;          /* use 3% of total memo
 static const int CACHE_SIZE_LIMIT = 256 * 1024 * 1024;   /* but not above 256MiB */
 static const int CACHE_SIZE_FALLBACK = 32 * 1024 * 1024; /* fallback to 32MiB if we can't determine total memory */
 
+/* number of images to decode in advance while idle in image mode, in the
+ * direction of navigation and in the opposite one.
+ * 0 for both disables prefetching.
+ */
+static const int PREFETCH_AHEAD  = 2;
+static const int PREFETCH_BEHIND = 1;
+
+/* images of at least this many megapixels are shown from their cached
+ * thumbnail first, decoding them is postponed until nsxiv is idle.
+ * 0 disables previews.
+ */
+static const int PREVIEW_MIN_MPIXELS = 8;
+
+/* images of at least this many megapixels in a format whose parts can be
+ * decoded on their own are not decoded as a whole, only the tiles in view are
+ * read from the file: binary PGM and PPM, farbfeld and, with libtiff, TIFF
+ * files stored in tiles. They are recognized by their file extension.
+ * 0 disables tiled loading.
+ */
+static const int TILED_MIN_MPIXELS = 100;
+static const int TILE_CACHE_SIZE = 64; /* in MiB */
+
+/* animations are decoded while they play, keeping at most this many MiB of
+ * decoded frames around. if all frames fit, they are decoded only once.
+ */
+static const int ANIM_BUFFER_SIZE = 256;
+
+/* every this many frames of an animation, a whole frame is kept regardless,
+ * so that going to any frame takes at most this many frames to be composed.
+ * lower values make seeking faster at the cost of memory. the checkpoints are
+ * placed farther apart if they would take more than half of ANIM_BUFFER_SIZE.
+ */
+static const int ANIM_CHECKPOINT_INTERVAL = 32;
+
+/* MiB of X server memory for animation frames as they appear in the window,
+ * which get shown again as long as the view doesn't change instead of being
+ * rendered every time they come up. 0 disables this.
+ */
+static const int ANIM_PIXMAP_SIZE = 64;
+
 #endif
 #ifdef INCLUDE_OPTIONS_CONFIG
 
@@ -70,6 +110,23 @@ static const bool ANTI_ALIAS = true;
  */
 static const bool ALPHA_LAYER = false;
 
+/* memory in MiB for decoded images that are not displayed right now, i.e.
+ * prefetched ones and recently viewed ones (overwritten via `--image-cache`).
+ * 0 disables caching and prefetching.
+ */
+static const int IMAGE_CACHE_SIZE = 512;
+
+/* if true, sort directory contents naturally, i.e. "img9" before "img10",
+ * instead of by plain collation order (overwritten via `--natural-sort` option)
+ */
+static const bool NATURAL_SORT = false;
+
+/* animations are rendered with at most this many frames per second while the
+ * window is obscured or unfocused, they keep their pace nevertheless
+ * (overwritten via `--idle-framerate`). 0 always renders every frame.
+ */
+static const int IDLE_FRAMERATE = 0;
+
 #endif
 #ifdef INCLUDE_THUMBS_CONFIG
 
@@ -12,9 +12,13 @@ OPT_DEP_DEFAULT = 1
 # autoreload backend: 1 = inotify, 0 = none
 HAVE_INOTIFY = $(OPT_DEP_DEFAULT)
 
+# timeout backend: 1 = timerfd, 0 = poll(2) timeout
+HAVE_TIMERFD = $(OPT_DEP_DEFAULT)
+
 # optional dependencies, see README for more info
 HAVE_LIBFONTS = $(OPT_DEP_DEFAULT)
 HAVE_LIBEXIF  = $(OPT_DEP_DEFAULT)
+HAVE_LIBTIFF  = $(OPT_DEP_DEFAULT)
 
 warning_flags := -Wall -Wextra -Wshadow \
 		 -Wredundant-decls -Wwrite-strings -Wstrict-prototypes -Wold-style-definition \
@@ -46,6 +50,7 @@ ICONS = 16x16.png 32x32.png 48x48.png 64x64.png 128x128.png
 
 # Uncomment on OpenBSD
 # HAVE_INOTIFY = 0
+# HAVE_TIMERFD = 0
 # lib_fonts_bsd_0 =
 # lib_fonts_bsd_1 = -lfreetype -L/usr/X11R6/lib/freetype2
 # inc_fonts_bsd_0 =
@@ -12,6 +12,7 @@ typedef struct {
     bool to_stdout;
     bool using_null;
     bool recursive;
+    bool natural_sort;
     int filecnt;
     int startnum;
 
@@ -22,8 +23,10 @@ typedef struct {
     bool anti_alias;
     bool alpha_layer;
     int gamma;
+    int image_cache;
     unsigned int slideshow;
     int framerate;
+    int idle_framerate;
 
     /* window: */
     bool fullscreen;
@@ -38,6 +41,8 @@ typedef struct {
     bool clean_cache;
     bool private_mode;
     bool background_cache;
+    bool stats;
+    const char *stats_file;
 } opt_t;
 
 
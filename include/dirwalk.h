@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* type byte in front of every name in dirwalk_dir_t.names */
+enum {
+    DW_FILE = 'f',
+    DW_LINK = 'l'  /* symlink, canonical path is not simply realpath + name */
+};
+
+/* Entries of a single directory, as collected by dirwalk() */
+typedef struct dirwalk_dir dirwalk_dir_t;
+struct dirwalk_dir {
+    dirwalk_dir_t *next;
+    char *path;     /* directory as reached from the walk's root */
+    char *realpath; /* canonical absolute path of the directory */
+    char *names;    /* non-directory entries: type byte + '\0' terminated name */
+    size_t len;
+    size_t cap;
+    int cnt;
+};
+
+typedef struct {
+    dirwalk_dir_t *dirs; /* in no particular order */
+    int filecnt;
+} dirwalk_t;
+
+
+// dirwalk.c {{{
+int dirwalk(dirwalk_t*, const char dirname[], bool recursive, bool skip_dotfiles)
+    __attribute__((nonnull (1, 2)));
+void dirwalk_free(dirwalk_t*)
+    __attribute__((nonnull (1)));
+// }}}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+#include "nsxiv.h"
+
+
+// filesort.c {{{
+void filesort(fileinfo_t*, int cnt, bool natural)
+    __attribute__((nonnull (1)));
+// }}}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/*
+ * GIF decoder that reads the frames of a file one after another from a single
+ * open file descriptor, parsing the file only once per pass.
+ */
+typedef struct gif gif_t;
+
+typedef enum {
+    GIF_DISPOSE_NONE,
+    GIF_DISPOSE_CLEAR,   /* restore the frame area to transparent */
+    GIF_DISPOSE_PREV     /* restore the frame area as it was before */
+} gif_dispose_t;
+
+typedef struct {
+    /* area of the canvas covered by the frame, clipped to the canvas */
+    int x, y, w, h;
+    int delay;           /* in milliseconds, 0 if unspecified */
+    gif_dispose_t dispose;
+    bool transparent;
+    /* w * h ARGB pixels, valid until the next call to gif_next_frame() */
+    uint32_t *pixels;
+} gif_frame_t;
+
+
+// gif.c {{{
+gif_t* gif_open(const char *path)
+    __attribute__((nonnull (1)));
+void gif_close(gif_t*);
+void gif_get_size(const gif_t*, int *w, int *h)
+    __attribute__((nonnull (1, 2, 3)));
+bool gif_next_frame(gif_t*, gif_frame_t*)
+    __attribute__((nonnull (1, 2)));
+off_t gif_tell(const gif_t*)
+    __attribute__((nonnull (1)));
+void gif_seek(gif_t*, off_t)
+    __attribute__((nonnull (1)));
+void gif_rewind(gif_t*)
+    __attribute__((nonnull (1)));
+// }}}
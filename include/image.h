@@ -1,7 +1,11 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 #include <Imlib2.h>
+#include "tiled.h"
 #include "window.h"
 
 
@@ -15,11 +19,52 @@
 #endif
 
 
+typedef enum {
+    IF_CHECKPAN = 1,
+    IF_IS_DIRTY = 2,
+    IF_ANTI_ALIAS_ENABLED = 4,
+    IF_HAS_ALPHA_LAYER = 8,
+    IF_IS_AUTORELOAD_PENDING = 16,
+    IF_IS_MODIFIED = 32,
+    IF_IS_PREVIEW = 64,
+} ImageFlags;
+
+
+/* what rendering an image into the window depends on besides its pixels */
 typedef struct {
-    Imlib_Image im;
+    float x;
+    float y;
+    float zoom;
+    unsigned int w;
+    unsigned int h;
+    int top;
+    ImageFlags flags;
+    int gamma;
+    int brightness;
+    int contrast;
+    bool mirror;
+    int rotation;
+} ImageView;
+
+
+/*
+ * Keyframes are the whole composed frame, the others only the area at x, y
+ * that differs from the frame before them. Frames get drawn onto the image
+ * they belong to, which always shows the selected one.
+ */
+typedef struct {
+    Imlib_Image im; /* NULL while not decoded */
+    int x;
+    int y;
+    int w;
+    int h;
+    bool key;
     unsigned int delay;
+    Pixmap pm;      /* as rendered into the window, None if it wasn't */
 } ImageFrame;
 
+typedef struct anim_decoder anim_decoder_t;
+
 
 // Used for animated images (GIFs...)
 typedef struct {
@@ -30,32 +75,49 @@ typedef struct {
     unsigned int sel;
     bool animate;
     int framedelay;
-    int length;
+    /* decoding of the frames that aren't in memory, at most keep are */
+    anim_decoder_t *dec;
+    unsigned int keep;
+    /* the frames' pixmaps show them at view and take pm_size bytes */
+    ImageView view;
+    size_t pm_size;
 } ImageFrameSet;
 
 
-typedef enum {
-    IF_CHECKPAN = 1,
-    IF_IS_DIRTY = 2,
-    IF_ANTI_ALIAS_ENABLED = 4,
-    IF_HAS_ALPHA_LAYER = 8,
-    IF_IS_AUTORELOAD_PENDING = 16,
-} ImageFlags;
+/* number of downscaled copies kept for zoom levels below 50% */
+enum { MIPMAP_LEVELS = 8 };
 
 
 typedef struct {
     Imlib_Image im;
-    int w;
+    int w; /* as shown, i.e. after rotating */
     int h;
+    /* of the file at the time it got decoded */
+    struct timespec mtime;
+    off_t fsize;
+    /* im downscaled by 2, 4, 8... built on demand by img_render() */
+    struct {
+        Imlib_Image levels[MIPMAP_LEVELS];
+        int cnt;
+    } mipmap;
+    /* for huge images, im is only an overview and the tiles in view get
+     * read from the file */
+    tiled_image_t *tiled;
 
     win_t *win;
     float x;
     float y;
+    /* rotating and flipping only changes how im is shown: mirrored
+     * horizontally, then rotated clockwise by 90 degrees rotation times */
+    bool mirror;
+    int rotation;
 
     Imlib_Color_Modifier cmod;
     int gamma;
     int brightness;
     int contrast;
+    /* what the color channels get mapped to according to the above */
+    uint8_t lut[256];
 
     scalemode_t scalemode;
     float zoom;
@@ -68,6 +130,14 @@ typedef struct {
     } slideshow_settings;
 
     ImageFrameSet multi;
+
+    /* state of the last rendering into win->buf.pm, which gets reused when
+     * nothing but the position changed, see win_save() */
+    struct {
+        Imlib_Image src;
+        ImageView view;
+        unsigned long gen; /* of win->buf, see win_save() */
+    } drawn;
 } SxivImage;
 
 
@@ -77,11 +147,25 @@ void img_init(SxivImage*, win_t*)
 bool img_load(SxivImage*, const fileinfo_t*)
     __attribute__((nonnull(1)));
 
+bool img_load_preview(SxivImage*, const fileinfo_t*, Imlib_Image)
+    __attribute__((nonnull(1, 2, 3)));
+
 CLEANUP void img_free(Imlib_Image, const bool decache);
 
 CLEANUP void img_close(SxivImage*, const bool decache)
     __attribute__((nonnull(1)));
 
+bool img_cache_load(SxivImage*, const fileinfo_t*)
+    __attribute__((nonnull(1, 2)));
+
+void img_cache_store(SxivImage*, const char *path)
+    __attribute__((nonnull(1, 2)));
+
+bool img_prefetch(const SxivImage*, int fileidx, int direction)
+    __attribute__((nonnull(1)));
+
+CLEANUP void img_cache_free(void);
+
 void img_render(SxivImage*)
     __attribute__((nonnull(1)));
 
@@ -125,7 +209,15 @@ bool img_change_color_modifier(SxivImage*, int, int*)
 bool img_frame_navigate(SxivImage*, int)
     __attribute__((nonnull(1)));
 
-bool img_frame_animate(SxivImage*)
+bool img_frame_decode(SxivImage*)
+    __attribute__((nonnull(1)));
+
+unsigned int img_frame_delay(const SxivImage*, unsigned int)
+    __attribute__((nonnull(1)));
+int img_anim_length(const SxivImage*)
+    __attribute__((nonnull(1)));
+
+bool img_frame_animate(SxivImage*, unsigned int)
     __attribute__((nonnull(1)));
 
 Imlib_Image img_open(const fileinfo_t*)
@@ -88,7 +88,7 @@ typedef enum {
 
 typedef struct {
     const char *name; /* as given by user */
-    const char *path; /* always absolute, result of realpath(3) */
+    const char *path; /* always absolute and canonical, as if by realpath(3) */
     fileflags_t flags;
 } fileinfo_t;
 
@@ -113,11 +113,12 @@ void slideshow(void);
 void clear_resize(void);
 
 void remove_file(int, bool);
-void set_timeout(timeout_f, int, bool);
-void reset_timeout(timeout_f);
 void close_info(void);
 void open_info(void);
 void load_image(int);
+void finish_preview(void);
+void anim_start(void);
+void anim_stop(void);
 bool mark_image(int, bool);
 int nav_button(void);
 void handle_key_handler(bool);
@@ -134,4 +135,16 @@ extern int g_prefix;
 
 // }}}
 
+// timer.c {{{
+
+void set_timeout(timeout_f, int, bool);
+void reset_timeout(timeout_f);
+bool timeout_active(timeout_f);
+bool check_timeouts(int*)
+    __attribute__((nonnull (1)));
+int timeout_fd(void);
+void timeout_cleanup(void);
+
+// }}}
+
 #endif /* NSXIV_H */
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Latency counters of the expensive stages. Every sample is recorded in a
+ * histogram with four buckets per power of two of its nanoseconds, precise
+ * enough for percentiles without keeping the samples.
+ */
+typedef enum {
+    STAT_DECODE,      /* img_open() */
+    STAT_SCALE,       /* tns_scale_down() */
+    STAT_CACHE_HIT,   /* tns_cache_load() that found a thumbnail */
+    STAT_CACHE_MISS,  /* tns_cache_load() that didn't */
+    STAT_CACHE_WRITE, /* tns_cache_write() */
+    STAT_IMG_RENDER,
+    STAT_TNS_RENDER,
+    STAT_WIN_DRAW,
+    STAT_X_ROUNDTRIP, /* requests that wait for a reply of the X server */
+    STAT_COUNT
+} stat_t;
+
+/* Events that are only counted */
+typedef enum {
+    COUNT_IMG_CACHE_HIT,
+    COUNT_IMG_CACHE_MISS,
+    COUNT_IMG_CACHE_STALE,    /* cached, but the file changed since */
+    COUNT_IMG_CACHE_PREFETCH,
+    COUNT_IMG_CACHE_EVICT,
+    COUNT_ANIM_SHOWN,
+    COUNT_ANIM_DROPPED,       /* skipped because rendering fell behind */
+    COUNT_ANIM_THROTTLED,     /* skipped while idle */
+    COUNT_ANIM_NOMINAL_MS,    /* sum of the delays of all these frames */
+    COUNT_ANIM_PLAYED_MS,     /* how long the animations actually played */
+    COUNT_COUNT
+} count_t;
+
+
+// stats.c {{{
+long long stats_now(void);
+void stats_add(stat_t, long long start);
+void stats_count(count_t, unsigned long n);
+void stats_request(int sig);
+void stats_check(void);
+void stats_dump(void);
+// }}}
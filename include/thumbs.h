@@ -41,6 +41,7 @@ enum {
 typedef struct {
     fileinfo_t *files;
     thumb_t *thumbs;
+    int cap;
     const int *cnt;
     int *sel;
     int next_to_init;
@@ -81,8 +82,14 @@ CLEANUP void tns_replace(
     replaceflags_t flags
 ) __attribute__((nonnull(1)));
 
+void tns_grow(ThumbnailState*, fileinfo_t*)
+    __attribute__((nonnull(1, 2)));
+
 void tns_clean_cache(void);
 
+Imlib_Image tns_cache_peek(const fileinfo_t*)
+    __attribute__((nonnull(1)));
+
 CLEANUP void tns_free(ThumbnailState*)
     __attribute__((nonnull(1)));
 
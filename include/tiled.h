@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <Imlib2.h>
+
+
+/* side length of tiles in pixels of their resolution level */
+enum { TILE_SIZE = 256 };
+
+/*
+ * Image in a file format whose parts can be decoded independently, decoded on
+ * demand in tiles instead of as a whole.
+ * Level n of the image is downscaled by 2^n in both directions.
+ */
+typedef struct tiled_image tiled_image_t;
+
+
+// tiled.c {{{
+bool tiled_supported(const char *path)
+    __attribute__((nonnull (1)));
+tiled_image_t* tiled_open(const char *path, long long min_pixels)
+    __attribute__((nonnull (1)));
+void tiled_close(tiled_image_t*);
+void tiled_get_size(const tiled_image_t*, int *w, int *h)
+    __attribute__((nonnull (1, 2, 3)));
+bool tiled_has_alpha(const tiled_image_t*)
+    __attribute__((nonnull (1)));
+Imlib_Image tiled_get_tile(tiled_image_t*, int level, int tx, int ty)
+    __attribute__((nonnull (1)));
+Imlib_Image tiled_overview(tiled_image_t*, int max_side)
+    __attribute__((nonnull (1)));
+void tiled_set_cache_size(size_t);
+// }}}
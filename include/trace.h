@@ -0,0 +1,19 @@
+#pragma once
+
+#include <sys/types.h>
+
+/*
+ * Spans in the Trace Event Format of chrome://tracing and Perfetto, written to
+ * the file named by the NSXIV_TRACE environment variable. Without it
+ * trace_start() returns 0 and nothing is recorded.
+ */
+
+// trace.c {{{
+void trace_init(void);
+void trace_close(void);
+long long trace_start(void);
+void trace_span(const char *name, long long start, const char *detail)
+    __attribute__((nonnull (1)));
+void trace_process(const char *cmd, pid_t, long long start)
+    __attribute__((nonnull (1)));
+// }}}
@@ -16,6 +16,17 @@ typedef struct {
     int stlen;
 } r_dir_t;
 
+/*
+ * Bump allocator for strings which live until the arena is freed as a whole,
+ * e.g. the names and paths of the file list.
+ */
+typedef struct arena_block arena_block_t;
+
+typedef struct {
+    arena_block_t *head;
+    size_t used;
+} arena_t;
+
 extern const char *progname;
 
 
@@ -24,6 +35,8 @@ void* emalloc(size_t);
 void* ecalloc(size_t, size_t);
 void* erealloc(void*, size_t);
 char* estrdup(const char*);
+char* arena_strndup(arena_t*, const char*, size_t)              __attribute__((nonnull (1, 2)));
+void arena_free(arena_t*)                                       __attribute__((nonnull (1)));
 void error_quit(int exit_code, int err_num, const char *msg_fmt, ...) __attribute__((noreturn));
 void error_log(int err_num, const char *fmt, ...);
 int r_opendir(r_dir_t*, const char dirname[], bool recursive)   __attribute__((nonnull (1, 2)));
@@ -77,6 +77,16 @@ typedef struct {
         unsigned int w;
         unsigned int h;
         Pixmap pm;
+        unsigned long gen; /* incremented by win_clear() */
+        /* copy of the area below or above the bar, see win_save() */
+        Pixmap frame;
+        unsigned int frame_w;
+        unsigned int frame_h;
+        unsigned long frame_gen; /* of the buffer content in frame */
+        bool save;
+        unsigned int save_w;
+        unsigned int save_h;
+        int save_top;
     } buf;
 
     struct {
@@ -100,6 +110,13 @@ bool win_configure(win_t*, const XConfigureEvent*);
 void win_toggle_fullscreen(win_t*);
 void win_toggle_bar(win_t*);
 void win_clear(win_t*);
+void win_shift(win_t*, int dx, int dy);
+void win_save(win_t*);
+void win_unsave(win_t*);
+bool win_restore(win_t*, unsigned long gen);
+Pixmap win_snapshot(win_t*);
+void win_put_snapshot(win_t*, Pixmap);
+void win_free_snapshot(win_t*, Pixmap);
 void win_draw(win_t*);
 void win_draw_rect(win_t *window, int x, int y, int w, int h, bool fill, int line_width, unsigned long color);
 void win_set_title(win_t*, const char *title, size_t length);
@@ -83,7 +83,7 @@ bool cg_switch_mode(CommandArg _)
     case MODE_IMAGE: 
         if (g_tns.thumbs == NULL)
             tns_init(&g_tns, g_files, &g_filecnt, &g_fileidx, &g_win);
-        img_close(&g_img, false);
+        img_cache_store(&g_img, g_files[g_fileidx].path);
         reset_timeout(reset_cursor);
         if (g_img.slideshow_settings.is_enabled) {
             g_img.slideshow_settings.is_enabled = false;
@@ -350,10 +350,10 @@ bool ci_toggle_animation(CommandArg _)
     if (g_img.multi.cnt > 0) {
         g_img.multi.animate = !g_img.multi.animate;
         if (g_img.multi.animate) {
-            dirty = img_frame_animate(&g_img);
-            set_timeout(animate, g_img.multi.frames[g_img.multi.sel].delay, true);
+            dirty = img_frame_animate(&g_img, 1);
+            anim_start();
         } else {
-            reset_timeout(animate);
+            anim_stop();
         }
     }
     return dirty;
@@ -439,6 +439,7 @@ bool ci_fit_to_win(CommandArg sm)
 
 bool ci_rotate(CommandArg degree)
 {
+    finish_preview();
     img_rotate(&g_img, degree);
     return true;
 }
@@ -446,6 +447,7 @@ bool ci_rotate(CommandArg degree)
 
 bool ci_flip(CommandArg dir)
 {
+    finish_preview();
     img_flip(&g_img, dir);
     return true;
 }
@@ -471,7 +473,7 @@ bool ci_slideshow(CommandArg _)
     if (g_prefix > 0) {
         g_img.slideshow_settings.is_enabled = true;
         g_img.slideshow_settings.delay = g_prefix * 10;
-        set_timeout(slideshow, g_img.slideshow_settings.delay * 100, true);
+        reset_timeout(slideshow); /* redraw() sets it with the new delay */
     } else if (g_img.slideshow_settings.is_enabled) {
         g_img.slideshow_settings.is_enabled = false;
         reset_timeout(slideshow);
@@ -0,0 +1,312 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE /* DT_* constants */
+
+#include "dirwalk.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+    DIRWALK_MAX_THREADS = 8,
+    /* upper bound for directory fds kept open by queued jobs, beyond this
+     * subdirectories get opened by path once a worker picks them up */
+    DIRWALK_MAX_FDS = 128,
+    DIRWALK_NAMES_MIN = 4096
+};
+
+
+typedef struct job {
+    struct job *next;
+    int fd;
+    char *path;
+    char *realpath;
+} job_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    job_t *jobs;
+    int busy; /* queued jobs + jobs in progress */
+    int fds;
+    bool recursive;
+    bool skip_dotfiles;
+    dirwalk_t *result;
+} walk_ctx_t;
+
+
+static void push_job(walk_ctx_t *ctx, int fd, char *path, char *real)
+{
+    job_t *job = emalloc(sizeof(*job));
+    job->fd = fd;
+    job->path = path;
+    job->realpath = real;
+
+    pthread_mutex_lock(&ctx->lock);
+    job->next = ctx->jobs;
+    ctx->jobs = job;
+    ctx->busy++;
+    pthread_cond_signal(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+static char *join_path(const char *dir, size_t dirlen, const char *name)
+{
+    size_t namelen = strlen(name);
+    bool slash = dir[dirlen - 1] != '/';
+    char *path = emalloc(dirlen + slash + namelen + 1);
+
+    memcpy(path, dir, dirlen);
+    path[dirlen] = '/';
+    memcpy(path + dirlen + slash, name, namelen + 1);
+    return path;
+}
+
+
+static void dir_add_name(dirwalk_dir_t *dir, const char *name, char type)
+{
+    size_t n = strlen(name) + 1;
+
+    if (dir->cap - dir->len < n + 1) {
+        dir->cap = MAX(MAX(dir->cap * 2, dir->len + n + 1), (size_t)DIRWALK_NAMES_MIN);
+        dir->names = erealloc(dir->names, dir->cap);
+    }
+    dir->names[dir->len] = type;
+    memcpy(dir->names + dir->len + 1, name, n);
+    dir->len += n + 1;
+    dir->cnt++;
+}
+
+
+static bool want_fd(walk_ctx_t *ctx)
+{
+    bool ret;
+
+    pthread_mutex_lock(&ctx->lock);
+    if ((ret = ctx->fds < DIRWALK_MAX_FDS))
+        ctx->fds++;
+    pthread_mutex_unlock(&ctx->lock);
+    return ret;
+}
+
+
+static void release_fd(walk_ctx_t *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->fds--;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+static dirwalk_dir_t *walk_dir(walk_ctx_t *ctx, const job_t *job)
+{
+    int fd = job->fd;
+    DIR *d;
+
+    if (fd < 0)
+        fd = open(job->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    else
+        release_fd(ctx);
+    if (fd < 0 || (d = fdopendir(fd)) == NULL) {
+        error_log(errno, "%s", job->path);
+        if (fd >= 0)
+            close(fd);
+        free(job->path);
+        free(job->realpath);
+        return NULL;
+    }
+
+    dirwalk_dir_t *dir = ecalloc(1, sizeof(*dir));
+    size_t pathlen = strlen(job->path);
+    size_t reallen = strlen(job->realpath);
+    const struct dirent *dentry;
+
+    dir->path = job->path;
+    dir->realpath = job->realpath;
+    while ((dentry = readdir(d)) != NULL) {
+        const char *name = dentry->d_name;
+        bool is_dir, is_link = false;
+
+        if (name[0] == '.' &&
+            (ctx->skip_dotfiles || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+#ifdef DT_DIR
+        if (dentry->d_type == DT_DIR) {
+            is_dir = true;
+        } else if (dentry->d_type == DT_REG) {
+            is_dir = false;
+        } else
+#endif
+        {
+            /* symlinks and filesystems without d_type */
+            struct stat fstats;
+            if (fstatat(dirfd(d), name, &fstats, AT_SYMLINK_NOFOLLOW) < 0)
+                continue;
+            if ((is_link = S_ISLNK(fstats.st_mode)) && fstatat(dirfd(d), name, &fstats, 0) < 0)
+                continue;
+            is_dir = S_ISDIR(fstats.st_mode);
+        }
+
+        if (!is_dir) {
+            dir_add_name(dir, name, is_link ? DW_LINK : DW_FILE);
+        } else if (ctx->recursive) {
+            int subfd = -1;
+            char *subpath = join_path(job->path, pathlen, name);
+            char *subreal = is_link ? realpath(subpath, NULL) : join_path(job->realpath, reallen, name);
+
+            if (subreal == NULL) {
+                error_log(errno, "%s", subpath);
+                free(subpath);
+                continue;
+            }
+            if (want_fd(ctx) && (subfd = openat(dirfd(d), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+                release_fd(ctx);
+            push_job(ctx, subfd, subpath, subreal);
+        }
+    }
+    closedir(d);
+    return dir;
+}
+
+
+static void *walk_worker(void *arg)
+{
+    walk_ctx_t *ctx = arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    while (true) {
+        while (ctx->jobs == NULL && ctx->busy > 0)
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        if (ctx->jobs == NULL)
+            break;
+
+        job_t *job = ctx->jobs;
+        ctx->jobs = job->next;
+        pthread_mutex_unlock(&ctx->lock);
+
+        dirwalk_dir_t *dir = walk_dir(ctx, job);
+        free(job);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (dir != NULL) {
+            dir->next = ctx->result->dirs;
+            ctx->result->dirs = dir;
+            ctx->result->filecnt += dir->cnt;
+        }
+        if (--ctx->busy == 0)
+            pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+
+static int walk_threads(bool recursive)
+{
+    long n = 1;
+
+    if (!recursive)
+        return 1;
+#ifdef _SC_NPROCESSORS_ONLN /* not POSIX */
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return MAX(1, MIN(n, DIRWALK_MAX_THREADS));
+}
+
+
+/*
+ * Collects the non-directory entries of dirname, and of all of its
+ * subdirectories if recursive is set. Subdirectories are scanned concurrently,
+ * so the order of the resulting dirs is unspecified.
+ * Only the root directory and symlinked subdirectories go through realpath(3),
+ * the canonical path of any other subdirectory is derived from its parent's.
+ */
+int dirwalk(dirwalk_t *walk, const char dirname[], bool recursive, bool skip_dotfiles)
+{
+    int fd;
+    char *real;
+    pthread_t threads[DIRWALK_MAX_THREADS];
+    int nthreads = walk_threads(recursive);
+    walk_ctx_t ctx = {
+        .recursive = recursive,
+        .skip_dotfiles = skip_dotfiles,
+        .result = walk,
+    };
+
+    walk->dirs = NULL;
+    walk->filecnt = 0;
+
+    if (*dirname == '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    if ((real = realpath(dirname, NULL)) == NULL)
+        return -1;
+    if ((fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        free(real);
+        return -1;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+    ctx.fds = 1;
+    push_job(&ctx, fd, estrdup(dirname), real);
+
+    /* the calling thread is worker number 0 */
+    for (int i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, walk_worker, &ctx) != 0) {
+            nthreads = i;
+            break;
+        }
+    }
+    walk_worker(&ctx);
+    for (int i = 1; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+    return 0;
+}
+
+
+void dirwalk_free(dirwalk_t *walk)
+{
+    while (walk->dirs != NULL) {
+        dirwalk_dir_t *next = walk->dirs->next;
+        free(walk->dirs->path);
+        free(walk->dirs->realpath);
+        free(walk->dirs->names);
+        free(walk->dirs);
+        walk->dirs = next;
+    }
+    walk->filecnt = 0;
+}
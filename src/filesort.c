@@ -0,0 +1,287 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "filesort.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    FILESORT_MAX_THREADS = 8,
+    /* lists shorter than this are sorted on the calling thread only */
+    FILESORT_PARALLEL_MIN = 16 * 1024
+};
+
+/* segment tags of natural sort keys, numbers sort before text */
+enum {
+    KEY_END = 0x01,
+    KEY_NUM = 0x02,
+    KEY_TEXT = 0x03
+};
+
+
+typedef struct {
+    union {
+        size_t off; /* while the key buffer can still move */
+        const unsigned char *p;
+    } key;
+    size_t len;
+    fileinfo_t file;
+} sortitem_t;
+
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+} keybuf_t;
+
+typedef struct {
+    sortitem_t *items;
+    const fileinfo_t *files;
+    int cnt;
+    bool natural;
+    keybuf_t kb;
+} chunk_t;
+
+typedef struct {
+    const sortitem_t *src;
+    sortitem_t *dst;
+    int lo, mid, hi;
+} merge_t;
+
+
+static unsigned char *kb_reserve(keybuf_t *kb, size_t n)
+{
+    if (kb->cap - kb->len < n) {
+        kb->cap = MAX(kb->cap * 2, kb->len + n);
+        kb->buf = erealloc(kb->buf, kb->cap);
+    }
+    return kb->buf + kb->len;
+}
+
+
+static void kb_put(keybuf_t *kb, unsigned char c)
+{
+    *kb_reserve(kb, 1) = c;
+    kb->len++;
+}
+
+
+/* appends the collation key of s, without its terminating '\0' */
+static void kb_xfrm(keybuf_t *kb, const char *s)
+{
+    size_t n = strxfrm(NULL, s, 0);
+    strxfrm((char *)kb_reserve(kb, n + 1), s, n + 1);
+    kb->len += n;
+}
+
+
+/*
+ * Appends n as a length prefix that memcmp() orders numerically: values below
+ * 0xFF as one byte, larger ones as 0xFF, their byte count and their bytes in
+ * big endian order.
+ */
+static void kb_len(keybuf_t *kb, size_t n)
+{
+    int bytes = 0;
+
+    if (n < 0xFF) {
+        kb_put(kb, n);
+        return;
+    }
+    for (size_t v = n; v != 0; v >>= 8)
+        bytes++;
+    kb_put(kb, 0xFF);
+    kb_put(kb, bytes);
+    while (bytes-- > 0)
+        kb_put(kb, n >> (bytes * 8) & 0xFF);
+}
+
+
+/*
+ * Natural keys are a sequence of segments: runs of digits are stored as their
+ * digit count followed by the digits without leading zeros, so that memcmp()
+ * orders them numerically, and everything in between as collation keys.
+ */
+static void kb_natural(keybuf_t *kb, const char *s)
+{
+    char buf[256], *seg;
+
+    while (*s != '\0') {
+        size_t n;
+        if (*s >= '0' && *s <= '9') {
+            while (s[0] == '0' && s[1] >= '0' && s[1] <= '9')
+                s++;
+            for (n = 0; s[n] >= '0' && s[n] <= '9'; n++)
+                ;
+            kb_put(kb, KEY_NUM);
+            kb_len(kb, n);
+            memcpy(kb_reserve(kb, n), s, n);
+            kb->len += n;
+        } else {
+            for (n = 0; s[n] != '\0' && (s[n] < '0' || s[n] > '9'); n++)
+                ;
+            /* strxfrm() needs the segment terminated, long ones are rare */
+            seg = n < sizeof(buf) ? buf : emalloc(n + 1);
+            memcpy(seg, s, n);
+            seg[n] = '\0';
+            kb_put(kb, KEY_TEXT);
+            kb_xfrm(kb, seg);
+            kb_put(kb, KEY_END);
+            if (seg != buf)
+                free(seg);
+        }
+        s += n;
+    }
+}
+
+
+static int itemcmp(const void *a, const void *b)
+{
+    const sortitem_t *x = a, *y = b;
+    int ret = memcmp(x->key.p, y->key.p, MIN(x->len, y->len));
+
+    if (ret == 0)
+        ret = (x->len > y->len) - (x->len < y->len);
+    return ret;
+}
+
+
+static void *sort_chunk(void *arg)
+{
+    chunk_t *c = arg;
+    int i;
+
+    for (i = 0; i < c->cnt; i++) {
+        size_t start = c->kb.len;
+        if (c->natural)
+            kb_natural(&c->kb, c->files[i].name);
+        else
+            kb_xfrm(&c->kb, c->files[i].name);
+        c->items[i].key.off = start;
+        c->items[i].len = c->kb.len - start;
+        c->items[i].file = c->files[i];
+    }
+    for (i = 0; i < c->cnt; i++)
+        c->items[i].key.p = c->kb.buf + c->items[i].key.off;
+    qsort(c->items, c->cnt, sizeof(*c->items), itemcmp);
+    return NULL;
+}
+
+
+static void *merge_runs(void *arg)
+{
+    const merge_t *m = arg;
+    int i = m->lo, j = m->mid, k = m->lo;
+
+    while (i < m->mid && j < m->hi)
+        m->dst[k++] = itemcmp(&m->src[j], &m->src[i]) < 0 ? m->src[j++] : m->src[i++];
+    while (i < m->mid)
+        m->dst[k++] = m->src[i++];
+    while (j < m->hi)
+        m->dst[k++] = m->src[j++];
+    return NULL;
+}
+
+
+static int sort_threads(int cnt)
+{
+    long n = 1;
+
+    if (cnt < FILESORT_PARALLEL_MIN)
+        return 1;
+#ifdef _SC_NPROCESSORS_ONLN /* not POSIX */
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return MAX(1, MIN(n, FILESORT_MAX_THREADS));
+}
+
+
+/*
+ * Sorts files by name according to LC_COLLATE. Collation keys are computed
+ * once per file with strxfrm(3) and compared with memcmp(3). Long lists are
+ * split into one chunk per thread and merged afterwards.
+ */
+void filesort(fileinfo_t *files, int cnt, bool natural)
+{
+    chunk_t chunks[FILESORT_MAX_THREADS];
+    pthread_t threads[FILESORT_MAX_THREADS];
+    bool spawned[FILESORT_MAX_THREADS];
+    int i, nchunks = sort_threads(cnt);
+    sortitem_t *items, *tmp;
+
+    if (cnt < 2)
+        return;
+
+    items = emalloc(cnt * sizeof(*items));
+    for (i = 0; i < nchunks; i++) {
+        int lo = (long long)cnt * i / nchunks;
+        int hi = (long long)cnt * (i + 1) / nchunks;
+        chunks[i] = (chunk_t){ .items = items + lo, .files = files + lo, .cnt = hi - lo, .natural = natural };
+    }
+    for (i = 1; i < nchunks; i++)
+        spawned[i] = pthread_create(&threads[i], NULL, sort_chunk, &chunks[i]) == 0;
+    sort_chunk(&chunks[0]);
+    for (i = 1; i < nchunks; i++) {
+        if (spawned[i])
+            pthread_join(threads[i], NULL);
+        else
+            sort_chunk(&chunks[i]);
+    }
+
+    /* pairwise merging of sorted chunks, one thread per pair */
+    tmp = nchunks > 1 ? emalloc(cnt * sizeof(*tmp)) : NULL;
+    for (int width = 1; width < nchunks; width *= 2) {
+        merge_t merges[FILESORT_MAX_THREADS];
+        int nmerges = 0;
+
+        for (i = 0; i < nchunks; i += 2 * width) {
+            int mid = MIN(i + width, nchunks), hi = MIN(i + 2 * width, nchunks);
+            merges[nmerges++] = (merge_t){
+                .src = items, .dst = tmp,
+                .lo = chunks[i].items - items,
+                .mid = mid < nchunks ? chunks[mid].items - items : cnt,
+                .hi = hi < nchunks ? chunks[hi].items - items : cnt,
+            };
+        }
+        for (i = 1; i < nmerges; i++)
+            spawned[i] = pthread_create(&threads[i], NULL, merge_runs, &merges[i]) == 0;
+        merge_runs(&merges[0]);
+        for (i = 1; i < nmerges; i++) {
+            if (spawned[i])
+                pthread_join(threads[i], NULL);
+            else
+                merge_runs(&merges[i]);
+        }
+        sortitem_t *swap = items;
+        items = tmp;
+        tmp = swap;
+    }
+
+    for (i = 0; i < cnt; i++)
+        files[i] = items[i].file;
+    for (i = 0; i < nchunks; i++)
+        free(chunks[i].kb.buf);
+    free(items);
+    free(tmp);
+}
@@ -0,0 +1,401 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gif.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+enum {
+    GIF_BUF_SIZE = 64 * 1024,
+    LZW_MAX_BITS = 12,
+    LZW_MAX_CODES = 1 << LZW_MAX_BITS
+};
+
+struct gif {
+    int fd;
+    int w;
+    int h;
+    off_t first;         /* offset of the first block after the header */
+    bool has_gpal;
+    uint32_t gpal[256];
+    uint32_t pal[256];   /* palette of the current frame */
+
+    /* buffered reading, buf holds the file contents at bufoff */
+    off_t bufoff;
+    size_t len;
+    size_t pos;
+    int block;           /* bytes left in the current data sub-block */
+
+    uint32_t *pixels;
+    size_t cap;
+
+    uint16_t prefix[LZW_MAX_CODES];
+    unsigned char suffix[LZW_MAX_CODES];
+    unsigned char stack[LZW_MAX_CODES + 1];
+    unsigned char buf[GIF_BUF_SIZE];
+};
+
+/* position of the next pixel of a frame, rows of interlaced frames are stored
+ * in four passes: every 8th row from 0, every 8th from 4, every 4th from 2 and
+ * every 2nd from 1 */
+typedef struct {
+    int col;
+    int row;
+    int pass;
+    bool interlaced;
+} cursor_t;
+
+
+static int rd_byte(gif_t *g)
+{
+    if (g->pos == g->len) {
+        ssize_t n;
+        g->bufoff += g->len;
+        g->len = g->pos = 0;
+        while ((n = pread(g->fd, g->buf, sizeof(g->buf), g->bufoff)) < 0 && errno == EINTR)
+            ;
+        if (n <= 0)
+            return -1;
+        g->len = n;
+    }
+    return g->buf[g->pos++];
+}
+
+
+static bool rd_skip(gif_t *g, int n)
+{
+    while (n-- > 0) {
+        if (rd_byte(g) < 0)
+            return false;
+    }
+    return true;
+}
+
+
+static int rd_u16(gif_t *g)
+{
+    int lo = rd_byte(g), hi = rd_byte(g);
+    return lo < 0 || hi < 0 ? -1 : lo | hi << 8;
+}
+
+
+static bool rd_palette(gif_t *g, uint32_t *pal, int n)
+{
+    for (int i = 0; i < n; i++) {
+        int r = rd_byte(g), gr = rd_byte(g), b = rd_byte(g);
+        if (b < 0)
+            return false;
+        pal[i] = 0xFFu << 24 | (uint32_t)r << 16 | (uint32_t)gr << 8 | b;
+    }
+    return true;
+}
+
+
+/* skips data sub-blocks up to and including the block terminator */
+static bool skip_blocks(gif_t *g)
+{
+    int n;
+
+    while ((n = rd_byte(g)) > 0) {
+        if (!rd_skip(g, n))
+            return false;
+    }
+    return n == 0;
+}
+
+
+/* next byte of the image data, -1 at its end */
+static int data_byte(gif_t *g)
+{
+    if (g->block == 0) {
+        if ((g->block = rd_byte(g)) <= 0) {
+            g->block = -1;
+            return -1;
+        }
+    } else if (g->block < 0) {
+        return -1;
+    }
+    g->block--;
+    return rd_byte(g);
+}
+
+
+gif_t *gif_open(const char *path)
+{
+    gif_t *g = ecalloc(1, sizeof(*g));
+    unsigned char sig[6];
+    int flags;
+
+    if ((g->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        free(g);
+        return NULL;
+    }
+    for (int i = 0; i < 6; i++)
+        sig[i] = rd_byte(g);
+    if (memcmp(sig, "GIF87a", 6) != 0 && memcmp(sig, "GIF89a", 6) != 0)
+        goto fail;
+    g->w = rd_u16(g);
+    g->h = rd_u16(g);
+    flags = rd_byte(g);
+    if (g->w <= 0 || g->h <= 0 || !rd_skip(g, 2) || flags < 0)
+        goto fail;
+    if ((g->has_gpal = flags & 0x80) && !rd_palette(g, g->gpal, 2 << (flags & 7)))
+        goto fail;
+    g->first = g->bufoff + g->pos;
+    return g;
+
+fail:
+    close(g->fd);
+    free(g);
+    return NULL;
+}
+
+
+void gif_close(gif_t *g)
+{
+    if (g == NULL)
+        return;
+    close(g->fd);
+    free(g->pixels);
+    free(g);
+}
+
+
+void gif_get_size(const gif_t *g, int *w, int *h)
+{
+    *w = g->w;
+    *h = g->h;
+}
+
+
+/* position of the next frame, for gif_seek() */
+off_t gif_tell(const gif_t *g)
+{
+    return g->bufoff + (off_t)g->pos;
+}
+
+
+/* continues reading frames at a position returned by gif_tell() */
+void gif_seek(gif_t *g, off_t off)
+{
+    if (off >= g->bufoff && off <= g->bufoff + (off_t)g->len) {
+        g->pos = off - g->bufoff;
+    } else {
+        g->bufoff = off;
+        g->len = g->pos = 0;
+    }
+}
+
+
+/* the following gif_next_frame() call returns the first frame again */
+void gif_rewind(gif_t *g)
+{
+    gif_seek(g, g->first);
+}
+
+
+static void cursor_advance(cursor_t *c, int w, int h)
+{
+    static const int start[] = { 0, 4, 2, 1 }, step[] = { 8, 8, 4, 2 };
+
+    if (++c->col < w)
+        return;
+    c->col = 0;
+    if (!c->interlaced) {
+        c->row++;
+        return;
+    }
+    c->row += step[c->pass];
+    while (c->row >= h && c->pass < 3)
+        c->row = start[++c->pass];
+}
+
+
+/*
+ * Decompresses the LZW coded indices of a fw x fh frame at fx, fy into the
+ * pixels of the clip area of the canvas. Missing data leaves pixels untouched.
+ */
+static void decode_lzw(gif_t *g, int min, bool interlaced,
+                       int fx, int fy, int fw, int fh, const gif_frame_t *clip)
+{
+    const int clear = 1 << min, eoi = clear + 1;
+    int size = min + 1, avail = clear + 2, prev = -1, first = 0;
+    uint32_t bits = 0;
+    int nbits = 0;
+    long long i, npix = (long long)fw * fh;
+    cursor_t cur = { .interlaced = interlaced };
+
+    for (int c = 0; c < clear; c++)
+        g->suffix[c] = c;
+
+    for (i = 0; i < npix;) {
+        int code, in, sp = 0;
+
+        while (nbits < size) {
+            int b = data_byte(g);
+            if (b < 0)
+                return;
+            bits |= (uint32_t)b << nbits;
+            nbits += 8;
+        }
+        code = bits & ((1u << size) - 1);
+        bits >>= size;
+        nbits -= size;
+
+        if (code == clear) {
+            size = min + 1;
+            avail = clear + 2;
+            prev = -1;
+            continue;
+        } else if (code == eoi) {
+            return;
+        }
+        in = code;
+        if (prev < 0) {
+            if (code > clear)
+                return;
+        } else if (code >= avail) {
+            if (code > avail)
+                return;
+            g->stack[sp++] = first;
+            code = prev;
+        }
+        while (code >= clear) {
+            g->stack[sp++] = g->suffix[code];
+            code = g->prefix[code];
+        }
+        g->stack[sp++] = first = code;
+
+        if (prev >= 0 && avail < LZW_MAX_CODES) {
+            g->prefix[avail] = prev;
+            g->suffix[avail] = first;
+            if (++avail == 1 << size && size < LZW_MAX_BITS)
+                size++;
+        }
+        prev = in;
+
+        for (; sp > 0 && i < npix; i++) {
+            int x = fx + cur.col - clip->x, y = fy + cur.row - clip->y;
+            uint32_t px = g->pal[g->stack[--sp]];
+            if (x >= 0 && x < clip->w && y >= 0 && y < clip->h && cur.row < fh)
+                clip->pixels[(size_t)y * clip->w + x] = px;
+            cursor_advance(&cur, fw, fh);
+        }
+    }
+}
+
+
+static bool read_image(gif_t *g, gif_frame_t *f, int transparent)
+{
+    int fx = rd_u16(g), fy = rd_u16(g), fw = rd_u16(g), fh = rd_u16(g);
+    int flags = rd_byte(g), min;
+    size_t npix;
+
+    if (flags < 0)
+        return false;
+    if (flags & 0x80) {
+        if (!rd_palette(g, g->pal, 2 << (flags & 7)))
+            return false;
+    } else if (g->has_gpal) {
+        memcpy(g->pal, g->gpal, sizeof(g->pal));
+    } else {
+        for (int i = 0; i < 256; i++)
+            g->pal[i] = 0xFFu << 24;
+    }
+    if (transparent >= 0)
+        g->pal[transparent] = 0;
+    if ((min = rd_byte(g)) < 1 || min > 8)
+        return false;
+
+    f->x = MIN(fx, g->w);
+    f->y = MIN(fy, g->h);
+    f->w = MIN(fx + fw, g->w) - f->x;
+    f->h = MIN(fy + fh, g->h) - f->y;
+    f->transparent = transparent >= 0;
+    if (f->w <= 0 || f->h <= 0) {
+        /* entirely outside of the canvas */
+        f->x = f->y = 0;
+        f->w = f->h = 1;
+        f->transparent = true;
+        f->dispose = GIF_DISPOSE_NONE;
+    }
+    npix = (size_t)f->w * f->h;
+    if (npix > g->cap) {
+        g->cap = npix;
+        free(g->pixels);
+        g->pixels = emalloc(g->cap * sizeof(*g->pixels));
+    }
+    f->pixels = g->pixels;
+    memset(f->pixels, 0, npix * sizeof(*f->pixels));
+
+    g->block = 0;
+    decode_lzw(g, min, flags & 0x40, fx, fy, fw, fh, f);
+    /* rest of the data, if any, up to the terminator */
+    if (g->block >= 0 && (!rd_skip(g, g->block) || !skip_blocks(g)))
+        return false;
+    return true;
+}
+
+
+/*
+ * Decodes the next frame of the file, returns false at its end or if it is
+ * broken. Only the area of the canvas the frame covers is decoded, composing
+ * the frames is up to the caller.
+ */
+bool gif_next_frame(gif_t *g, gif_frame_t *f)
+{
+    int transparent = -1;
+
+    memset(f, 0, sizeof(*f));
+    while (true) {
+        int c = rd_byte(g), label, size, flags;
+
+        switch (c) {
+        case 0x21: /* extension */
+            if ((label = rd_byte(g)) == 0xF9) {
+                /* graphic control extension */
+                if ((size = rd_byte(g)) < 4)
+                    return false;
+                flags = rd_byte(g);
+                f->delay = rd_u16(g) * 10;
+                transparent = rd_byte(g);
+                if (flags < 0 || f->delay < 0 || transparent < 0 || !rd_skip(g, size - 4))
+                    return false;
+                if (!(flags & 1))
+                    transparent = -1;
+                f->dispose = (flags >> 2 & 7) == 2 ? GIF_DISPOSE_CLEAR :
+                             (flags >> 2 & 7) == 3 ? GIF_DISPOSE_PREV : GIF_DISPOSE_NONE;
+            }
+            if (label < 0 || !skip_blocks(g))
+                return false;
+            break;
+        case 0x2C: /* image descriptor */
+            return read_image(g, f, transparent);
+        default: /* 0x3B trailer, end of file or garbage */
+            return false;
+        }
+    }
+}
@@ -20,12 +20,16 @@
 #include "image.h"
 
 #include "cli_options.h"
+#include "gif.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 #define INCLUDE_IMAGE_CONFIG
 #include "config.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,17 +39,63 @@
 #if HAVE_LIBEXIF
 #include <libexif/exif-data.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+/* the AVX2 color table lookup is chosen at runtime, the build stays generic */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LUT_AVX2 1
+#include <immintrin.h>
+#endif
 
-#if HAVE_IMLIB2_MULTI_FRAME
 enum { DEF_ANIM_DELAY = 75 };
+
+#if HAVE_IMLIB2_MULTI_FRAME
+enum {
+    /* animation frames that differ from the previous one in at least this
+     * percentage of their area are kept whole */
+    ANIM_KEYFRAME_AREA = 50
+};
 #endif
+/* maximum side length of the overview of tiled images */
+enum { TILED_OVERVIEW_SIZE = 1024 };
 
 #define ZOOM_MIN (zoom_levels[0] / 100)
 #define ZOOM_MAX (zoom_levels[ARRLEN(zoom_levels) - 1] / 100)
 
 
+/* a decoded image, kept by the image cache while it isn't displayed */
+typedef struct {
+    const char *path; /* g_files[].path, outlives its file list entry */
+    SxivImage img;
+    size_t size;
+    unsigned long used; /* for LRU eviction */
+    bool failed;
+} cache_entry_t;
+
+
 extern opt_t *g_options;
 
+static struct {
+    cache_entry_t *entries;
+    int cnt;
+    int cap;
+    size_t size;
+    size_t limit;
+    unsigned long clock;
+    /* prefetching state */
+    int fileidx;
+    int dir;
+    bool done; /* nothing left to prefetch around fileidx */
+} imcache = { .fileidx = -1 };
+
+/* for compositing transparent images */
+static struct {
+    uint32_t *bg;
+    int bgw;
+    uint32_t bgkey; /* background color, 0 for the checkerboard */
+} blendbuf;
+
 
 static int calc_cache_size(void)
 {
@@ -73,8 +123,14 @@ void img_init(SxivImage *img, win_t *win)
     imlib_context_set_visual(win->env.vis);
     imlib_context_set_colormap(win->env.cmap);
     imlib_set_cache_size(calc_cache_size());
+    imcache.limit = (size_t)g_options->image_cache << 20;
+    tiled_set_cache_size((size_t)TILE_CACHE_SIZE << 20);
 
     img->im = NULL;
+    img->tiled = NULL;
+    img->drawn.src = NULL;
+    img->mirror = false;
+    img->rotation = 0;
     img->win = win;
     img->scalemode = g_options->scalemode;
     img->zoom = g_options->zoom;
@@ -86,14 +142,16 @@ void img_init(SxivImage *img, win_t *win)
     img->flags |= (ImageFlags[]){0, IF_HAS_ALPHA_LAYER}[g_options->alpha_layer];
 
     img->multi.cap = img->multi.cnt = 0;
+    img->multi.dec = NULL;
     img->multi.animate = g_options->animate;
     img->multi.framedelay = g_options->framerate > 0 ? 1000 / g_options->framerate : 0;
-    img->multi.length = 0;
 
     img->cmod = imlib_create_color_modifier();
     imlib_context_set_color_modifier(img->cmod);
+    img->gamma = 0;
     img->brightness = 0;
     img->contrast = 0;
+    img_update_color_modifiers(img);
     img_change_color_modifier(img, g_options->gamma, &img->gamma);
 
     img->slideshow_settings.is_enabled = g_options->slideshow > 0;
@@ -141,6 +199,72 @@ void exif_auto_orientate(const fileinfo_t *file)
 }
 #endif
 
+/* disposal of a frame, restore is the area it covers as it was before it got
+ * drawn */
+typedef struct {
+    int dispose;
+    int px, py, pw, ph;
+    Imlib_Image restore;
+} anim_disposal_t;
+
+/* state of the decoder right after composing a checkpoint frame */
+typedef struct {
+    anim_disposal_t prev;
+    off_t offset;            /* of the following frame in a GIF */
+    bool valid;
+} anim_checkpoint_t;
+
+/* state of decoding an animation frame by frame */
+struct anim_decoder {
+    char *path;
+    char *name;
+    gif_t *gif;              /* frames of GIFs are read in a single pass */
+    int fcnt;
+    int w;
+    int h;
+    unsigned int next;       /* index of the next frame to decode */
+    unsigned int resident;   /* number of decoded frames in memory */
+    size_t size;             /* of the decoded frames in bytes */
+    Imlib_Image canvas;      /* composition of the frames before next */
+    anim_disposal_t prev;    /* of the frame before next */
+    /* every interval-th frame is a keyframe that doesn't get evicted */
+    unsigned int interval;
+    anim_checkpoint_t *ckpts;
+    unsigned int nckpts;
+};
+
+
+static void anim_decoder_free(ImageFrameSet *m)
+{
+    if (m->dec == NULL)
+        return;
+    img_free(m->dec->canvas, false);
+    img_free(m->dec->prev.restore, false);
+    for (unsigned int i = 0; i < m->dec->nckpts; i++)
+        img_free(m->dec->ckpts[i].prev.restore, false);
+    free(m->dec->ckpts);
+    gif_close(m->dec->gif);
+    free(m->dec->path);
+    free(m->dec->name);
+    free(m->dec);
+    m->dec = NULL;
+}
+
+
+static void anim_free_pixmaps(SxivImage *img)
+{
+    ImageFrameSet *m = &img->multi;
+
+    for (unsigned int i = 0; i < m->cnt; i++) {
+        if (m->frames[i].pm != None) {
+            win_free_snapshot(img->win, m->frames[i].pm);
+            m->frames[i].pm = None;
+        }
+    }
+    m->pm_size = 0;
+}
+
+
 #if HAVE_IMLIB2_MULTI_FRAME
 static void img_area_clear(int x, int y, int w, int h)
 {
@@ -153,115 +277,429 @@ static void img_area_clear(int x, int y, int w, int h)
 }
 
 
-static bool img_load_multiframe(SxivImage *img, const fileinfo_t *file)
+/* frames that are neither the selected one nor checkpoints, farthest behind it first */
+static void anim_evict(SxivImage *img, unsigned int keep)
 {
-    unsigned int n, fcnt;
-    Imlib_Image blank;
-    Imlib_Frame_Info finfo;
-    int px, py, pw, ph, pflag;
     ImageFrameSet *m = &img->multi;
 
-    imlib_context_set_image(img->im);
-    imlib_image_get_frame_info(&finfo);
-    if ((fcnt = finfo.frame_count) <= 1 || !(finfo.frame_flags & IMLIB_IMAGE_ANIMATED))
+    for (unsigned int dist = m->cnt - 1; dist > 0 && m->dec->resident > m->keep; dist--) {
+        unsigned int i = (m->sel + dist) % m->cnt;
+        ImageFrame *f = &m->frames[i];
+        if (f->im != NULL && i != keep && i % m->dec->interval != 0) {
+            img_free(f->im, false);
+            f->im = NULL;
+            m->dec->resident--;
+            m->dec->size -= (size_t)f->w * f->h * sizeof(uint32_t);
+        }
+    }
+}
+
+
+/*
+ * Reads frame n of a GIF, which has to be the one after the previous call or
+ * the first one. Unlike imlib_load_image_frame(), which parses the file from
+ * its start up to frame n every time, this keeps the file open and its position
+ * in between, so loading all frames only reads through the file once.
+ */
+static Imlib_Image anim_gif_frame(anim_decoder_t *dec, unsigned int n, Imlib_Frame_Info *finfo)
+{
+    gif_frame_t f;
+    Imlib_Image im;
+
+    if (n == 0)
+        gif_rewind(dec->gif);
+    if (!gif_next_frame(dec->gif, &f) ||
+        (im = imlib_create_image_using_copied_data(f.w, f.h, f.pixels)) == NULL)
+    {
+        return NULL;
+    }
+    imlib_context_set_image(im);
+    imlib_image_set_has_alpha(f.transparent);
+
+    memset(finfo, 0, sizeof(*finfo));
+    finfo->frame_count = dec->fcnt;
+    finfo->frame_num = n + 1;
+    finfo->canvas_w = dec->w;
+    finfo->canvas_h = dec->h;
+    finfo->frame_x = f.x;
+    finfo->frame_y = f.y;
+    finfo->frame_w = f.w;
+    finfo->frame_h = f.h;
+    finfo->frame_delay = f.delay;
+    finfo->frame_flags = IMLIB_IMAGE_ANIMATED;
+    if (f.transparent)
+        finfo->frame_flags |= IMLIB_FRAME_BLEND;
+    if (f.dispose == GIF_DISPOSE_CLEAR)
+        finfo->frame_flags |= IMLIB_FRAME_DISPOSE_CLEAR;
+    else if (f.dispose == GIF_DISPOSE_PREV)
+        finfo->frame_flags |= IMLIB_FRAME_DISPOSE_PREV;
+    return im;
+}
+
+
+/*
+ * Keeps the composed frame n, which differs from frame n - 1 in the area from
+ * x0, y0 to x1, y1 only. Unless that covers most of the frame or n is a
+ * checkpoint, only the area is kept.
+ */
+static bool anim_store_frame(SxivImage *img, unsigned int n, int x0, int y0, int x1, int y1)
+{
+    ImageFrameSet *m = &img->multi;
+    anim_decoder_t *dec = m->dec;
+    ImageFrame *f = &m->frames[n];
+    Imlib_Image frame;
+    size_t avg;
+
+    x0 = MAX(x0, 0);
+    y0 = MAX(y0, 0);
+    x1 = MIN(x1, dec->w);
+    y1 = MIN(y1, dec->h);
+    if (x1 <= x0 || y1 <= y0) {
+        /* nothing changed, a pixel of it is the same as the previous one */
+        x0 = y0 = 0;
+        x1 = y1 = 1;
+    }
+    f->key = n % dec->interval == 0 || (long long)(x1 - x0) * (y1 - y0) * 100 >=
+                       (long long)dec->w * dec->h * ANIM_KEYFRAME_AREA;
+    if (f->key) {
+        x0 = y0 = 0;
+        x1 = dec->w;
+        y1 = dec->h;
+    }
+    f->x = x0;
+    f->y = y0;
+    f->w = x1 - x0;
+    f->h = y1 - y0;
+
+    imlib_context_set_image(dec->canvas);
+    if ((frame = imlib_create_cropped_image(f->x, f->y, f->w, f->h)) == NULL)
         return false;
-    img->w = finfo.canvas_w;
-    img->h = finfo.canvas_h;
+    f->im = frame;
 
-    if (fcnt > m->cap) {
-        m->cap = fcnt;
-        m->frames = erealloc(m->frames, m->cap * sizeof(*m->frames));
+    dec->resident++;
+    dec->size += (size_t)f->w * f->h * sizeof(uint32_t);
+    /* as many frames as their average size allows for */
+    avg = dec->size / dec->resident;
+    m->keep = MAX(2, MIN(m->cnt, ((size_t)ANIM_BUFFER_SIZE << 20) / avg));
+    return true;
+}
+
+
+/* remembers the state of the decoder after composing frame n */
+static void anim_save_checkpoint(anim_decoder_t *dec, unsigned int n)
+{
+    anim_checkpoint_t *c = &dec->ckpts[n / dec->interval];
+
+    if (c->valid)
+        return;
+    c->prev = dec->prev;
+    if (dec->prev.restore != NULL) {
+        imlib_context_set_image(dec->prev.restore);
+        if ((c->prev.restore = imlib_clone_image()) == NULL)
+            return;
     }
+    c->offset = dec->gif != NULL ? gif_tell(dec->gif) : 0;
+    c->valid = true;
+}
 
-    if ((blank = imlib_create_image(img->w, img->h)) == NULL) {
-        error_log(0, "%s: couldn't create image", file->name);
+
+/*
+ * Decodes the next frame of the animation, composing it on top of the
+ * previous ones. raw is the frame as loaded by Imlib2 if that already happened,
+ * it isn't freed here.
+ */
+static bool anim_decode_next(SxivImage *img, Imlib_Image raw)
+{
+    ImageFrameSet *m = &img->multi;
+    anim_decoder_t *dec = m->dec;
+    Imlib_Frame_Info finfo;
+    Imlib_Image loaded = NULL;
+    unsigned int n;
+    int sx, sy, sw, sh, x0, y0, x1, y1;
+    bool has_alpha;
+
+    if (dec->next >= m->cnt)
+        dec->next = 0;
+    n = dec->next;
+    if (raw == NULL && dec->gif != NULL) {
+        raw = loaded = anim_gif_frame(dec, n, &finfo);
+    } else {
+        if (raw == NULL)
+            raw = loaded = imlib_load_image_frame(dec->path, n + 1);
+        if (raw != NULL) {
+            imlib_context_set_image(raw);
+            imlib_image_set_changes_on_disk(); /* see img_load() for rationale */
+            imlib_image_get_frame_info(&finfo);
+        }
+    }
+    /* NOTE: the underlying file can end up changing while playing.
+     * so check if frame_count, w, h are all still the same or not.
+     */
+    if (raw == NULL || finfo.frame_count != dec->fcnt ||
+        finfo.canvas_w != dec->w || finfo.canvas_h != dec->h)
+    {
+        img_free(loaded, false);
+        error_log(0, "%s: failed to load frame %d", dec->name, n + 1);
+        m->cnt = n;
+        m->keep = MIN(m->keep, m->cnt);
         return false;
     }
-    imlib_context_set_image(blank);
-    img_area_clear(0, 0, img->w, img->h);
+    sx = finfo.frame_x;
+    sy = finfo.frame_y;
+    sw = finfo.frame_w;
+    sh = finfo.frame_h;
+    has_alpha = imlib_image_has_alpha();
 
     imlib_context_set_dither(0);
     imlib_context_set_anti_alias(0);
     imlib_context_set_color_modifier(NULL);
     imlib_context_set_operation(IMLIB_OP_COPY);
+    imlib_context_set_image(dec->canvas);
 
     /*
      * Imlib2 gives back a "raw frame", we need to blend it on top of the
      * previous frame ourselves if necessary to get the fully decoded frame.
+     * the dispose flags are explained in Imlib2's header
      */
-    pflag = m->length = m->cnt = m->sel = 0;
-    px = py = pw = ph = 0;
-    for (n = 1; n <= fcnt; ++n) {
-        Imlib_Image frame, canvas;
-        int sx, sy, sw, sh;
-        bool has_alpha;
-
-        imlib_context_set_image(m->cnt < 1 ? blank : m->frames[m->cnt - 1].im);
-        canvas = imlib_clone_image();
-        if ((frame = imlib_load_image_frame(file->path, n)) != NULL) {
-            imlib_context_set_image(frame);
-            imlib_image_set_changes_on_disk(); /* see img_load() for rationale */
-            imlib_image_get_frame_info(&finfo);
-        }
-        /* NOTE: the underlying file can end up changing during load.
-         * so check if frame_count, w, h are all still the same or not.
-         */
-        if (canvas == NULL || frame == NULL || finfo.frame_count != (int)fcnt ||
-            finfo.canvas_w != img->w || finfo.canvas_h != img->h)
-        {
-            img_free(frame, false);
+    if (n == 0) {
+        img_area_clear(0, 0, dec->w, dec->h);
+    } else if (dec->prev.dispose & IMLIB_FRAME_DISPOSE_CLEAR) {
+        img_area_clear(dec->prev.px, dec->prev.py, dec->prev.pw, dec->prev.ph);
+    } else if ((dec->prev.dispose & IMLIB_FRAME_DISPOSE_PREV) && dec->prev.restore != NULL) {
+        imlib_context_set_blend(0);
+        imlib_blend_image_onto_image(dec->prev.restore, 1, 0, 0, dec->prev.pw, dec->prev.ph,
+                                     dec->prev.px, dec->prev.py, dec->prev.pw, dec->prev.ph);
+    }
+    img_free(dec->prev.restore, false);
+    dec->prev.restore = NULL;
+    imlib_context_set_image(dec->canvas);
+
+    /* the area that differs from the previous frame */
+    x0 = sx;
+    y0 = sy;
+    x1 = sx + sw;
+    y1 = sy + sh;
+    if (n > 0 && (dec->prev.dispose & (IMLIB_FRAME_DISPOSE_CLEAR | IMLIB_FRAME_DISPOSE_PREV))) {
+        x0 = MIN(x0, dec->prev.px);
+        y0 = MIN(y0, dec->prev.py);
+        x1 = MAX(x1, dec->prev.px + dec->prev.pw);
+        y1 = MAX(y1, dec->prev.py + dec->prev.ph);
+    }
+
+    dec->prev.dispose = finfo.frame_flags;
+    dec->prev.px = sx;
+    dec->prev.py = sy;
+    dec->prev.pw = sw;
+    dec->prev.ph = sh;
+    if (dec->prev.dispose & IMLIB_FRAME_DISPOSE_PREV)
+        dec->prev.restore = imlib_create_cropped_image(sx, sy, sw, sh);
+
+    assert(imlib_context_get_operation() == IMLIB_OP_COPY);
+    imlib_image_set_has_alpha(has_alpha);
+    imlib_context_set_blend(!!(finfo.frame_flags & IMLIB_FRAME_BLEND));
+    imlib_blend_image_onto_image(raw, has_alpha, 0, 0, sw, sh, sx, sy, sw, sh);
+    img_free(loaded, false);
+
+    /* frames can still be there from before playback started over */
+    if (m->frames[n].im == NULL && !anim_store_frame(img, n, x0, y0, x1, y1)) {
+        error_log(0, "%s: couldn't create image", dec->name);
+        anim_free_pixmaps(img);
+        m->cnt = n;
+        m->keep = MIN(m->keep, m->cnt);
+        imlib_context_set_color_modifier(img->cmod);
+        return false;
+    }
+    if (m->frames[n].delay == 0) {
+        m->frames[n].delay = m->framedelay ? m->framedelay :
+                             (finfo.frame_delay ? finfo.frame_delay : DEF_ANIM_DELAY);
+    }
+    if (n % dec->interval == 0)
+        anim_save_checkpoint(dec, n);
+    dec->next = n + 1;
+    anim_evict(img, n);
+    imlib_context_set_color_modifier(img->cmod); /* restore cmod */
+    return true;
+}
+
+
+/*
+ * Puts the decoder back to right after composing frame n, a checkpoint, so
+ * that it continues from there instead of from the start.
+ */
+static bool anim_restore_checkpoint(SxivImage *img, unsigned int n)
+{
+    ImageFrameSet *m = &img->multi;
+    anim_decoder_t *dec = m->dec;
+    const anim_checkpoint_t *c = &dec->ckpts[n / dec->interval];
+    Imlib_Image canvas, restore = NULL;
+
+    if (!c->valid || m->frames[n].im == NULL)
+        return false;
+    imlib_context_set_image(m->frames[n].im);
+    if ((canvas = imlib_clone_image()) == NULL)
+        return false;
+    if (c->prev.restore != NULL) {
+        imlib_context_set_image(c->prev.restore);
+        if ((restore = imlib_clone_image()) == NULL) {
             img_free(canvas, false);
-            error_log(0, "%s: failed to load frame %d", file->name, n);
-            break;
+            return false;
         }
+    }
+    img_free(dec->canvas, false);
+    img_free(dec->prev.restore, false);
+    dec->canvas = canvas;
+    dec->prev = c->prev;
+    dec->prev.restore = restore;
+    if (dec->gif != NULL)
+        gif_seek(dec->gif, c->offset);
+    dec->next = n + 1;
+    return true;
+}
 
-        sx = finfo.frame_x;
-        sy = finfo.frame_y;
-        sw = finfo.frame_w;
-        sh = finfo.frame_h;
-        has_alpha = imlib_image_has_alpha();
-
-        imlib_context_set_image(canvas);
-        /* the dispose flags are explained in Imlib2's header */
-        if (pflag & IMLIB_FRAME_DISPOSE_CLEAR) {
-            img_area_clear(px, py, pw, ph);
-        } else if (pflag & IMLIB_FRAME_DISPOSE_PREV) {
-            Imlib_Image p = m->cnt < 2 ? blank : m->frames[m->cnt - 2].im;
-            assert(m->cnt > 0);
-            img_area_clear(0, 0, img->w, img->h);
-            imlib_blend_image_onto_image(p, 1, px, py, pw, ph, px, py, pw, ph);
-        }
-        pflag = finfo.frame_flags;
-        if (pflag & (IMLIB_FRAME_DISPOSE_CLEAR | IMLIB_FRAME_DISPOSE_PREV)) {
-            /* remember these so we can "dispose" them before blending next frame */
-            px = sx;
-            py = sy;
-            pw = sw;
-            ph = sh;
+
+/* draws frame n onto img->im, which has to show frame n - 1 unless n is a keyframe */
+static void anim_draw_frame(SxivImage *img, unsigned int n)
+{
+    const ImageFrame *f = &img->multi.frames[n];
+    bool has_alpha;
+
+    imlib_context_set_image(f->im);
+    has_alpha = imlib_image_has_alpha();
+    imlib_context_set_image(img->im);
+    imlib_context_set_color_modifier(NULL);
+    imlib_context_set_operation(IMLIB_OP_COPY);
+    imlib_context_set_blend(0);
+    imlib_blend_image_onto_image(f->im, 1, 0, 0, f->w, f->h, f->x, f->y, f->w, f->h);
+    imlib_image_set_has_alpha(has_alpha);
+    imlib_context_set_color_modifier(img->cmod);
+}
+
+
+/*
+ * Brings img->im from showing frame sel to frame n. Starting from the closest
+ * keyframe before n, or from sel if that is closer, all frames up to n get
+ * drawn. If any of them isn't in memory, the decoder has to compose n instead,
+ * which takes at most dec->interval frames as well.
+ */
+static bool anim_seek(SxivImage *img, unsigned int n)
+{
+    ImageFrameSet *m = &img->multi;
+    anim_decoder_t *dec = m->dec;
+    unsigned int i = n;
+    Imlib_Image im;
+
+    /* the first frame is always a keyframe */
+    while (m->frames[i].im != NULL && !m->frames[i].key && i != m->sel + 1)
+        i--;
+    if (m->frames[i].im != NULL) {
+        for (; i <= n; i++)
+            anim_draw_frame(img, i);
+        return true;
+    }
+
+    if (dec == NULL)
+        return false;
+    /* dec->canvas shows the frame before dec->next, continue from there or
+     * from the closest checkpoint before n, whichever is closer */
+    for (int c = n / dec->interval; c >= 0; c--) {
+        unsigned int k = c * dec->interval;
+        if ((dec->next <= n + 1 && dec->next > k) || anim_restore_checkpoint(img, k))
+            break;
+    }
+    if (dec->next > n + 1)
+        dec->next = 0;
+    while (dec->next != n + 1) {
+        if (!anim_decode_next(img, NULL) || n >= m->cnt)
+            return false;
+    }
+    imlib_context_set_image(dec->canvas);
+    if ((im = imlib_clone_image()) == NULL)
+        return false;
+    img_free(img->im, false);
+    img->im = im;
+    return true;
+}
+
+
+/*
+ * Only the first frame of animations gets decoded here, the following ones
+ * by img_frame_decode() while idle or when they are needed. At most
+ * ANIM_BUFFER_SIZE worth of frames are kept, of which the checkpoints are
+ * never evicted.
+ */
+static bool img_load_multiframe(SxivImage *img, const fileinfo_t *file)
+{
+    unsigned int fcnt;
+    Imlib_Frame_Info finfo;
+    ImageFrameSet *m = &img->multi;
+    anim_decoder_t *dec;
+    Imlib_Image canvas = NULL;
+    size_t frame_size, max_ckpts;
+
+    imlib_context_set_image(img->im);
+    imlib_image_get_frame_info(&finfo);
+    if ((fcnt = finfo.frame_count) <= 1 || !(finfo.frame_flags & IMLIB_IMAGE_ANIMATED))
+        return false;
+
+    if (fcnt > m->cap) {
+        m->cap = fcnt;
+        m->frames = erealloc(m->frames, m->cap * sizeof(*m->frames));
+    }
+    memset(m->frames, 0, fcnt * sizeof(*m->frames));
+
+    dec = ecalloc(1, sizeof(*dec));
+    dec->fcnt = fcnt;
+    dec->w = finfo.canvas_w;
+    dec->h = finfo.canvas_h;
+    if ((dec->canvas = imlib_create_image(dec->w, dec->h)) == NULL) {
+        error_log(0, "%s: couldn't create image", file->name);
+        free(dec);
+        imlib_context_set_image(img->im);
+        return false;
+    }
+    dec->path = estrdup(file->path);
+    dec->name = estrdup(file->name);
+    if ((dec->gif = gif_open(file->path)) != NULL) {
+        int w, h;
+        gif_get_size(dec->gif, &w, &h);
+        if (w != dec->w || h != dec->h) {
+            gif_close(dec->gif);
+            dec->gif = NULL;
         }
-        assert(imlib_context_get_operation() == IMLIB_OP_COPY);
-        imlib_image_set_has_alpha(has_alpha);
-        imlib_context_set_blend(!!(finfo.frame_flags & IMLIB_FRAME_BLEND));
-        imlib_blend_image_onto_image(frame, has_alpha, 0, 0, sw, sh, sx, sy, sw, sh);
-        m->frames[m->cnt].im = canvas;
-        m->frames[m->cnt].delay = m->framedelay ? m->framedelay :
-                                  (finfo.frame_delay ? finfo.frame_delay : DEF_ANIM_DELAY);
-        m->length += m->frames[m->cnt].delay;
-        m->cnt++;
-        img_free(frame, false);
-    }
-    img_free(blank, false);
-    imlib_context_set_color_modifier(img->cmod); /* restore cmod */
+    }
 
-    if (m->cnt > 1) {
-        img_free(img->im, false);
-        img->im = m->frames[0].im;
-    } else if (m->cnt == 1) {
+    frame_size = (size_t)dec->w * dec->h * sizeof(uint32_t);
+    /* checkpoints take up at most half of the buffer */
+    max_ckpts = MAX(1, ((size_t)ANIM_BUFFER_SIZE << 20) / 2 / frame_size);
+    dec->interval = MAX((size_t)MAX(ANIM_CHECKPOINT_INTERVAL, 1), (fcnt + max_ckpts - 1) / max_ckpts);
+    dec->nckpts = (fcnt + dec->interval - 1) / dec->interval;
+    dec->ckpts = ecalloc(dec->nckpts, sizeof(*dec->ckpts));
+    m->dec = dec;
+    m->cnt = fcnt;
+    m->keep = MAX(2, MIN(fcnt, ((size_t)ANIM_BUFFER_SIZE << 20) / frame_size));
+    m->sel = 0;
+
+    /* the first frame is already loaded, but reading it again keeps the GIF
+     * reader's position in step with the frames */
+    if (anim_decode_next(img, dec->gif != NULL ? NULL : img->im)) {
+        /* the frames get drawn onto a copy of the first one */
+        imlib_context_set_image(m->frames[0].im);
+        canvas = imlib_clone_image();
+    }
+    if (canvas == NULL) {
         img_free(m->frames[0].im, false);
+        m->frames[0].im = NULL;
+        anim_decoder_free(m);
         m->cnt = 0;
+        imlib_context_set_image(img->im);
+        return false;
     }
+    img_free(img->im, false);
+    img->w = dec->w;
+    img->h = dec->h;
+    img->im = canvas;
     imlib_context_set_image(img->im);
-    return m->cnt > 0;
+    return true;
 }
 #endif /* HAVE_IMLIB2_MULTI_FRAME */
 
@@ -269,6 +707,7 @@ Imlib_Image img_open(const fileinfo_t *file)
 {
     struct stat st;
     Imlib_Image im = NULL;
+    long long t = stats_now();
 
     if (access(file->path, R_OK) == 0 &&
         stat(file->path, &st) == 0 && S_ISREG(st.st_mode) &&
@@ -280,6 +719,7 @@ Imlib_Image img_open(const fileinfo_t *file)
     {
         imlib_context_set_image(im);
     }
+    stats_add(STAT_DECODE, t);
     /* UPGRADE: Imlib2 v1.10.0: better error reporting with
      * imlib_get_error() + imlib_strerror() */
     if (im == NULL && (file->flags & FF_WARN))
@@ -288,11 +728,47 @@ Imlib_Image img_open(const fileinfo_t *file)
 }
 
 
-bool img_load(SxivImage *img, const fileinfo_t *file)
+/*
+ * Opens file as a tiled image, with a downscaled overview of all of it in
+ * img->im for the lowest zoom levels.
+ */
+static bool img_load_tiled(SxivImage *img, const fileinfo_t *file)
+{
+    tiled_image_t *t;
+    Imlib_Image overview;
+
+    if ((t = tiled_open(file->path, TILED_MIN_MPIXELS * 1000000LL)) == NULL)
+        return false;
+    if ((overview = tiled_overview(t, TILED_OVERVIEW_SIZE)) == NULL) {
+        tiled_close(t);
+        return false;
+    }
+    img->tiled = t;
+    img->im = overview;
+    tiled_get_size(t, &img->w, &img->h);
+    imlib_context_set_image(overview);
+    img->flags &= ~(IF_IS_MODIFIED | IF_IS_PREVIEW);
+    img->flags |= IF_CHECKPAN | IF_IS_DIRTY;
+    return true;
+}
+
+
+static bool img_load_file(SxivImage *img, const fileinfo_t *file)
 {
     const char *fmt;
     bool animated = false;
+    struct stat st;
 
+    img->drawn.src = NULL;
+    img->mirror = false;
+    img->rotation = 0;
+    /* before decoding, so that changes during it are noticed by the cache */
+    if (stat(file->path, &st) == 0) {
+        img->mtime = st.st_mtim;
+        img->fsize = st.st_size;
+    }
+    if (TILED_MIN_MPIXELS > 0 && tiled_supported(file->path) && img_load_tiled(img, file))
+        return true;
     if ((img->im = img_open(file)) == NULL)
         return false;
 
@@ -328,12 +804,71 @@ bool img_load(SxivImage *img, const fileinfo_t *file)
         img->w = imlib_image_get_width();
         img->h = imlib_image_get_height();
     }
+    img->flags &= ~(IF_IS_MODIFIED | IF_IS_PREVIEW);
     img->flags |= IF_CHECKPAN | IF_IS_DIRTY;
 
     return true;
 }
 
 
+bool img_load(SxivImage *img, const fileinfo_t *file)
+{
+    long long t = trace_start();
+    bool ok = img_load_file(img, file);
+
+    trace_span("img_load", t, file->name);
+    return ok;
+}
+
+
+/*
+ * Shows preview, a downscaled version of file, in place of the full image
+ * until img_load() gets called. Only the header of file is read here, for the
+ * geometry to be that of the full image.
+ */
+bool img_load_preview(SxivImage *img, const fileinfo_t *file, Imlib_Image preview)
+{
+    Imlib_Image im;
+    int w, h, pw, ph;
+
+    /* imlib_load_image() defers decoding until the data gets accessed */
+    if ((im = imlib_load_image(file->path)) == NULL) {
+        img_free(preview, false);
+        return false;
+    }
+    imlib_context_set_image(im);
+    w = imlib_image_get_width();
+    h = imlib_image_get_height();
+    imlib_free_image();
+
+    imlib_context_set_image(preview);
+    pw = imlib_image_get_width();
+    ph = imlib_image_get_height();
+    if (PREVIEW_MIN_MPIXELS <= 0 || (long long)w * h < PREVIEW_MIN_MPIXELS * 1000000LL ||
+        pw <= 0 || ph <= 0)
+    {
+        img_free(preview, false);
+        return false;
+    }
+    /* the thumbnail already has the exif orientation applied */
+    if ((w > h && pw < ph) || (w < h && pw > ph)) {
+        int tmp = w;
+        w = h;
+        h = tmp;
+    }
+
+    img->im = preview;
+    img->drawn.src = NULL;
+    img->mirror = false;
+    img->rotation = 0;
+    img->w = w;
+    img->h = h;
+    img->flags &= ~IF_IS_MODIFIED;
+    img->flags |= IF_IS_PREVIEW | IF_CHECKPAN | IF_IS_DIRTY;
+    return true;
+}
+
+
 CLEANUP void img_free(Imlib_Image im, const bool decache)
 {
     if (im != NULL) {
@@ -343,10 +878,60 @@ CLEANUP void img_free(Imlib_Image im, const bool decache)
 }
 
 
+static void img_mipmap_free(SxivImage *img)
+{
+    for (int i = 0; i < img->mipmap.cnt; i++)
+        img_free(img->mipmap.levels[i], false);
+    img->mipmap.cnt = 0;
+}
+
+
+/*
+ * Returns im downscaled by 2^level, building the missing levels from the
+ * next bigger one, which is about as cheap as scaling the full image once.
+ */
+static Imlib_Image img_mipmap(SxivImage *img, int level)
+{
+    while (img->mipmap.cnt < level) {
+        Imlib_Image src = img->mipmap.cnt == 0 ? img->im : img->mipmap.levels[img->mipmap.cnt - 1];
+        Imlib_Image dst;
+        int w, h;
+        bool alpha;
+
+        imlib_context_set_image(src);
+        w = imlib_image_get_width();
+        h = imlib_image_get_height();
+        alpha = imlib_image_has_alpha();
+        if (w < 2 || h < 2)
+            break;
+        imlib_context_set_anti_alias(1);
+        imlib_context_set_color_modifier(NULL);
+        dst = imlib_create_cropped_scaled_image(0, 0, w, h, w / 2, h / 2);
+        imlib_context_set_color_modifier(img->cmod);
+        if (dst == NULL)
+            break;
+        imlib_context_set_image(dst);
+        imlib_image_set_has_alpha(alpha);
+        img->mipmap.levels[img->mipmap.cnt++] = dst;
+    }
+    level = MIN(level, img->mipmap.cnt);
+    return level == 0 ? img->im : img->mipmap.levels[level - 1];
+}
+
+
 CLEANUP void img_close(SxivImage *img, const bool decache)
 {
     unsigned int i;
 
+    img_mipmap_free(img);
+    tiled_close(img->tiled);
+    img->tiled = NULL;
+    img->drawn.src = NULL;
+    img->mirror = false;
+    img->rotation = 0;
+
+    anim_decoder_free(&img->multi);
+    anim_free_pixmaps(img);
     if (img->multi.cnt > 0) {
         for (i = 0; i < img->multi.cnt; i++)
             img_free(img->multi.frames[i].im, decache);
@@ -367,11 +952,280 @@ CLEANUP void img_close(SxivImage *img, const bool decache)
     #endif
 #endif
         img->multi.cnt = 0;
-        img->im = NULL;
-    } else if (img->im != NULL) {
-        img_free(img->im, decache);
-        img->im = NULL;
     }
+    img_free(img->im, decache);
+    img->im = NULL;
+}
+
+
+static size_t img_size(const SxivImage *img)
+{
+    if (img->tiled != NULL) {
+        /* tiles are accounted for by their own cache */
+        imlib_context_set_image(img->im);
+        return (size_t)imlib_image_get_width() * imlib_image_get_height() * sizeof(uint32_t);
+    }
+    size_t size = (size_t)img->w * img->h;
+
+    for (unsigned int i = 0; i < img->multi.cnt; i++) {
+        if (img->multi.frames[i].im != NULL)
+            size += (size_t)img->multi.frames[i].w * img->multi.frames[i].h;
+    }
+
+    for (int i = 1; i <= img->mipmap.cnt; i++)
+        size += (size_t)(img->w >> i) * (img->h >> i);
+    return size * sizeof(uint32_t);
+}
+
+
+static void cache_drop(int i, bool evicted)
+{
+    cache_entry_t *e = &imcache.entries[i];
+
+    img_mipmap_free(&e->img);
+    tiled_close(e->img.tiled);
+    anim_decoder_free(&e->img.multi);
+    /* decache, there is no point in Imlib2 keeping a second copy around */
+    for (unsigned int k = 0; k < e->img.multi.cnt; k++)
+        img_free(e->img.multi.frames[k].im, evicted);
+    img_free(e->img.im, evicted);
+    free(e->img.multi.frames);
+    imcache.size -= e->size;
+    stats_count(COUNT_IMG_CACHE_EVICT, evicted);
+    *e = imcache.entries[--imcache.cnt];
+}
+
+
+static int cache_find(const char *path)
+{
+    for (int i = 0; i < imcache.cnt; i++) {
+        if (imcache.entries[i].path == path)
+            return i;
+    }
+    return -1;
+}
+
+
+/* the n-th file to prefetch around fileidx, looking in direction dir first */
+static int prefetch_target(int fileidx, int dir, int n)
+{
+    return n < PREFETCH_AHEAD ? fileidx + dir * (n + 1)
+                              : fileidx - dir * (n - PREFETCH_AHEAD + 1);
+}
+
+
+static bool is_prefetch_target(const char *path)
+{
+    for (int n = 0; n < PREFETCH_AHEAD + PREFETCH_BEHIND; n++) {
+        int t = prefetch_target(imcache.fileidx, imcache.dir, n);
+        if (t >= 0 && t < g_filecnt && g_files[t].path == path)
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * Evicts least recently used entries until size more bytes fit into the
+ * budget. Prefetching must not evict other prefetched neighbours, or it would
+ * keep decoding them in turns.
+ */
+static bool cache_reserve(size_t size, bool keep_neighbours)
+{
+    if (size > imcache.limit)
+        return false;
+    while (imcache.size + size > imcache.limit) {
+        int lru = -1;
+        for (int i = 0; i < imcache.cnt; i++) {
+            if ((lru < 0 || imcache.entries[i].used < imcache.entries[lru].used) &&
+                !(keep_neighbours && is_prefetch_target(imcache.entries[i].path)))
+            {
+                lru = i;
+            }
+        }
+        if (lru < 0)
+            return false;
+        cache_drop(lru, true);
+    }
+    if (imcache.cnt == imcache.cap) {
+        imcache.cap = MAX(imcache.cap * 2, 16);
+        imcache.entries = erealloc(imcache.entries, imcache.cap * sizeof(*imcache.entries));
+    }
+    return true;
+}
+
+
+/* moves the decoded state of src into the closed image dst */
+static void img_move_data(SxivImage *dst, SxivImage *src)
+{
+    ImageFrame *frames = dst->multi.frames;
+    unsigned int cap = dst->multi.cap;
+
+    assert(dst->im == NULL && dst->multi.cnt == 0 && dst->mipmap.cnt == 0 && dst->tiled == NULL);
+    /* the window might not even show it at the same view again */
+    anim_free_pixmaps(src);
+    dst->im = src->im;
+    dst->mipmap = src->mipmap;
+    dst->tiled = src->tiled;
+    dst->drawn = src->drawn;
+    dst->w = src->w;
+    dst->h = src->h;
+    dst->mtime = src->mtime;
+    dst->fsize = src->fsize;
+    dst->multi.frames = src->multi.frames;
+    dst->multi.cap = src->multi.cap;
+    dst->multi.cnt = src->multi.cnt;
+    dst->multi.dec = src->multi.dec;
+    dst->multi.keep = src->multi.keep;
+    dst->multi.sel = src->multi.sel;
+
+    src->im = NULL;
+    src->mipmap.cnt = 0;
+    src->tiled = NULL;
+    src->drawn.src = NULL;
+    src->multi.frames = frames;
+    src->multi.cap = cap;
+    src->multi.cnt = 0;
+    src->multi.dec = NULL;
+}
+
+
+static bool img_is_stale(const SxivImage *img, const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) != 0 || st.st_size != img->fsize ||
+           st.st_mtim.tv_sec != img->mtime.tv_sec || st.st_mtim.tv_nsec != img->mtime.tv_nsec;
+}
+
+
+/*
+ * Moves the cached image of file into img, which has to be closed.
+ * Returns false if file isn't cached or changed on disk since it was decoded.
+ */
+bool img_cache_load(SxivImage *img, const fileinfo_t *file)
+{
+    int i;
+
+    if ((i = cache_find(file->path)) < 0 || imcache.entries[i].failed) {
+        stats_count(COUNT_IMG_CACHE_MISS, 1);
+        if (i >= 0)
+            cache_drop(i, false);
+        return false;
+    }
+    if (img_is_stale(&imcache.entries[i].img, file->path)) {
+        stats_count(COUNT_IMG_CACHE_STALE, 1);
+        cache_drop(i, true);
+        return false;
+    }
+    stats_count(COUNT_IMG_CACHE_HIT, 1);
+    img_move_data(img, &imcache.entries[i].img);
+    img->flags &= ~(IF_IS_MODIFIED | IF_IS_PREVIEW);
+    img->flags |= IF_CHECKPAN | IF_IS_DIRTY;
+    imlib_context_set_image(img->im);
+    cache_drop(i, false);
+    return true;
+}
+
+
+/*
+ * Closes img, keeping its decoded state in the cache if it fits. Previews and
+ * images that were rotated or flipped are not kept.
+ */
+void img_cache_store(SxivImage *img, const char *path)
+{
+    size_t size = img_size(img);
+    cache_entry_t *e;
+
+    if (img->im == NULL || (img->flags & (IF_IS_MODIFIED | IF_IS_PREVIEW)) ||
+        cache_find(path) >= 0 || !cache_reserve(size, false))
+    {
+        img_close(img, false);
+        return;
+    }
+    e = &imcache.entries[imcache.cnt++];
+    memset(e, 0, sizeof(*e));
+    e->path = path;
+    e->size = size;
+    e->used = ++imcache.clock;
+    img_move_data(&e->img, img);
+    imcache.size += size;
+}
+
+
+/*
+ * Decodes the next missing neighbour of fileidx into the cache, the following
+ * PREFETCH_AHEAD files in direction dir take precedence over the
+ * PREFETCH_BEHIND preceding ones. Meant to be called repeatedly while idle,
+ * returns false once there is nothing left to do.
+ */
+bool img_prefetch(const SxivImage *img, int fileidx, int dir)
+{
+    if (imcache.limit == 0)
+        return false;
+    if (fileidx != imcache.fileidx || dir != imcache.dir) {
+        imcache.fileidx = fileidx;
+        imcache.dir = dir;
+        imcache.done = false;
+    }
+    if (imcache.done)
+        return false;
+
+    for (int n = 0; n < PREFETCH_AHEAD + PREFETCH_BEHIND; n++) {
+        int t = prefetch_target(fileidx, dir, n);
+        fileinfo_t file;
+        cache_entry_t *e, tmp;
+        bool fits;
+
+        if (t < 0 || t >= g_filecnt || cache_find(g_files[t].path) >= 0)
+            continue;
+        if (!cache_reserve(0, true))
+            break;
+
+        /* errors are reported once the file actually gets loaded */
+        file = g_files[t];
+        file.flags &= ~FF_WARN;
+        e = &imcache.entries[imcache.cnt++];
+        memset(e, 0, sizeof(*e));
+        e->path = file.path;
+        e->used = ++imcache.clock;
+        e->img = *img;
+        e->img.im = NULL;
+        e->img.mipmap.cnt = 0;
+        e->img.tiled = NULL;
+        e->img.multi.frames = NULL;
+        e->img.multi.cap = e->img.multi.cnt = 0;
+        e->img.multi.dec = NULL;
+        e->failed = !img_load(&e->img, &file);
+        e->size = e->failed ? 0 : img_size(&e->img);
+        stats_count(COUNT_IMG_CACHE_PREFETCH, 1);
+
+        /* the size is only known now, make room for it afterwards */
+        tmp = imcache.entries[--imcache.cnt];
+        fits = cache_reserve(tmp.size, true);
+        imcache.entries[imcache.cnt++] = tmp;
+        imcache.size += tmp.size;
+        if (!fits) {
+            cache_drop(imcache.cnt - 1, true);
+            imcache.done = true;
+        }
+        if (img->im != NULL)
+            imlib_context_set_image(img->im);
+        return true;
+    }
+    imcache.done = true;
+    return false;
+}
+
+
+CLEANUP void img_cache_free(void)
+{
+    while (imcache.cnt > 0)
+        cache_drop(imcache.cnt - 1, false);
+    free(imcache.entries);
+    imcache.entries = NULL;
+    imcache.cap = 0;
+    imcache.fileidx = -1;
 }
 
 
@@ -437,98 +1291,485 @@ static bool img_fit(SxivImage *img)
 }
 
 
-void img_render(SxivImage *img)
+/*
+ * Background of transparent images: two rows of the 8x8 checkerboard alpha
+ * layer or of the window background color, repeating every 16 pixels.
+ */
+static const uint32_t *img_blend_bg(const SxivImage *img, int w)
 {
-    img_fit(img);
+    uint32_t key = 0;
 
-    if (img->flags & IF_CHECKPAN) {
-        img_check_pan(img, false);
-        img->flags &= ~IF_CHECKPAN;
+    if (!(img->flags & IF_HAS_ALPHA_LAYER)) {
+        XColor c = img->win->win_bg;
+        key = 0xFF000000 | (c.red >> 8) << 16 | (c.green >> 8) << 8 | c.blue >> 8;
+    }
+    w += 16;
+    if (blendbuf.bgw < w || blendbuf.bgkey != key) {
+        const uint32_t col[2] = { 0xFF666666, 0xFF999999 };
+
+        blendbuf.bgw = MAX(blendbuf.bgw, w);
+        blendbuf.bg = erealloc(blendbuf.bg, 2 * blendbuf.bgw * sizeof(*blendbuf.bg));
+        blendbuf.bgkey = key;
+        for (int i = 0; i < 2 * blendbuf.bgw; i++) {
+            int odd = i >= blendbuf.bgw, x = i - odd * blendbuf.bgw;
+            blendbuf.bg[i] = key != 0 ? key : col[((x >> 3) & 1) ^ odd];
+        }
     }
+    return blendbuf.bg;
+}
 
-    if (!(img->flags & IF_IS_DIRTY))
+
+#ifdef __SSE2__
+/* s * a + b * (255 - a) / 255 for the 16 bit channels of two pixels */
+static __m128i blend2(__m128i s, __m128i b)
+{
+    const __m128i max = _mm_set1_epi16(0xFF), half = _mm_set1_epi16(0x80);
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a),
+                                            _mm_mullo_epi16(b, _mm_sub_epi16(max, a))), half);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+
+/* composes n pixels of src over the opaque background bg into dst */
+static void blend_row(uint32_t *dst, const uint32_t *src, const uint32_t *bg, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_slli_epi32(_mm_set1_epi32(0xFF), 24);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&bg[i]);
+        __m128i lo = blend2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = blend2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(b, zero));
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t a = src[i] >> 24, p = 0xFF000000;
+        for (int shift = 0; shift < 24; shift += 8) {
+            uint32_t t = (src[i] >> shift & 0xFF) * a + (bg[i] >> shift & 0xFF) * (0xFF - a) + 0x80;
+            p |= ((t + (t >> 8)) >> 8) << shift;
+        }
+        dst[i] = p;
+    }
+}
+
+
+#ifdef LUT_AVX2
+/*
+ * Looks up the three color channels of eight pixels at once with gathers,
+ * which is why lut has 32 bit entries. 16 entry byte shuffles would need 16
+ * of them per channel and are slower than the scalar loop with SSSE3.
+ */
+__attribute__((target("avx2")))
+static int lut_row_avx2(uint32_t *p, int n, const uint32_t *lut)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256i alpha = _mm256_slli_epi32(mask, 24);
+    const int *t = (const int *)lut;
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)&p[i]);
+        __m256i r = _mm256_i32gather_epi32(t, _mm256_and_si256(_mm256_srli_epi32(c, 16), mask), 4);
+        __m256i g = _mm256_i32gather_epi32(t, _mm256_and_si256(_mm256_srli_epi32(c, 8), mask), 4);
+        __m256i b = _mm256_i32gather_epi32(t, _mm256_and_si256(c, mask), 4);
+        r = _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(g, 8));
+        r = _mm256_or_si256(_mm256_or_si256(r, b), _mm256_and_si256(c, alpha));
+        _mm256_storeu_si256((__m256i *)&p[i], r);
+    }
+    return i;
+}
+#endif
+
+
+/* maps the color channels of n pixels through lut */
+static void lut_row(uint32_t *p, int n, const uint32_t *lut)
+{
+    int i = 0;
+
+#ifdef LUT_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        i = lut_row_avx2(p, n, lut);
+#endif
+    for (; i < n; i++) {
+        uint32_t c = p[i];
+        p[i] = (c & 0xFF000000) | lut[c >> 16 & 0xFF] << 16 | lut[c >> 8 & 0xFF] << 8 | lut[c & 0xFF];
+    }
+}
+
+
+/*
+ * Renders the part of src scaled to dw x dh with its top left corner at dx, dy,
+ * for what Imlib2 would do with the full image otherwise: color adjustments,
+ * composing transparent images onto the window background or the checkerboard
+ * alpha layer, whose pattern starts at ox, oy, and rotating and flipping.
+ */
+static void img_render_scaled(SxivImage *img, Imlib_Image src, int sx, int sy, int sw, int sh,
+                              int dx, int dy, int dw, int dh, int ox, int oy)
+{
+    Imlib_Image scaled;
+    bool alpha, adjust = img->gamma != 0 || img->brightness != 0 || img->contrast != 0;
+
+    imlib_context_set_image(src);
+    alpha = imlib_image_has_alpha();
+    if ((scaled = imlib_create_cropped_scaled_image(sx, sy, sw, sh, dw, dh)) == NULL) {
+        error_log(ENOMEM, "Failed to create image");
         return;
+    }
+    imlib_context_set_image(scaled);
+    if (alpha || adjust) {
+        const uint32_t *bg = alpha ? img_blend_bg(img, dw) : NULL;
+        uint32_t *buf = imlib_image_get_data(), lut[256];
+
+        for (int i = 0; adjust && i < 256; i++)
+            lut[i] = img->lut[i];
+        for (int y = 0; y < dh; y++) {
+            uint32_t *row = &buf[y * dw];
+            if (adjust)
+                lut_row(row, dw, lut);
+            if (alpha)
+                blend_row(row, row, &bg[(((oy + y) >> 3) & 1) * blendbuf.bgw + (ox & 15)], dw);
+        }
+        imlib_image_put_back_data(buf);
+        imlib_image_set_has_alpha(0);
+    }
+    if (img->mirror)
+        imlib_image_flip_horizontal();
+    if (img->rotation != 0)
+        imlib_image_orientate(img->rotation);
 
-    win_t *win = img->win;
-    /* calculate source and destination offsets:
-     *   - part of image drawn on full window, or
-     *   - full image drawn on part of window
-     */
-    int sx, sw, dx, dw;
-    if (img->x <= 0) {
-        sx = (int)(-img->x / img->zoom + 0.5);
-        sw = win->w / img->zoom;
-        dx = 0;
-        dw = win->w;
-    } else {
-        sx = 0;
-        sw = img->w;
-        dx = img->x;
-        dw = MAX(img->w * img->zoom, 1);
-    }
-
-    int sy, sh, dy, dh;
-    if (img->y <= 0) {
-        sy = (int)(-img->y / img->zoom + 0.5);
-        sh = win->h / img->zoom;
-        dy = win->bar.top ? win->bar.h : 0;
-        dh = win->h;
-    } else {
-        sy = 0;
-        sh = img->h;
-        dy = img->y + (win->bar.top ? win->bar.h : 0);
-        dh = MAX(img->h * img->zoom, 1);
+    imlib_context_set_color_modifier(NULL);
+    imlib_render_image_on_drawable(dx, dy);
+    imlib_context_set_color_modifier(img->cmod);
+    img_free(scaled, false);
+}
+
+
+static int ifloor(float f)
+{
+    int i = (int)f;
+    return i - (f < i);
+}
+
+
+/*
+ * Maps the source pixels [0, n) spanning [p0, p1) of the full image onto the
+ * window, clipped to [lo, hi): the visible pixels start at *s0 and end before
+ * *s1, and get drawn at *d with size *dsize.
+ * Only whole source pixels are drawn, even if that means drawing beyond the
+ * clip range, so that separately drawn parts line up.
+ */
+static bool img_map_span(float pos, float zoom, int p0, int p1, int n, int lo, int hi,
+                         int *s0, int *s1, int *d, int *dsize)
+{
+    int d0 = ifloor(pos + p0 * zoom), d1 = MAX(ifloor(pos + p1 * zoom), d0 + 1);
+    float scale = (float)(d1 - d0) / n;
+    int c0 = MAX(d0, lo), c1 = MIN(d1, hi);
+
+    if (c0 >= c1)
+        return false;
+    *s0 = MIN((int)((c0 - d0) / scale), n - 1);
+    *s1 = MIN((int)((c1 - d0) / scale), n);
+    if (d0 + *s1 * scale < c1 && *s1 < n)
+        (*s1)++;
+    *d = d0 + (int)(*s0 * scale);
+    *dsize = MAX(d0 + (int)(*s1 * scale + 0.5f) - *d, 1);
+    return true;
+}
+
+
+/*
+ * The image placed in the window turned back along with it, so that the image
+ * is upright there. A window pixel at x, y is at the pixel of the placement
+ * that span_flip() maps swap ? y : x and swap ? x : y to along its axes.
+ */
+typedef struct {
+    float x;
+    float y;
+    int w;      /* size of the image before rotating */
+    int h;
+    bool swap;  /* the window's x axis is the placement's y axis */
+    bool rx;    /* the axes run the other way */
+    bool ry;
+} placement_t;
+
+
+static placement_t img_placement(const SxivImage *img)
+{
+    /* whether the axes of the image run backwards after each rotation */
+    static const bool rev[4][2] = { { false, false }, { false, true }, { true, true }, { true, false } };
+    placement_t p;
+    float x, y;
+
+    p.swap = img->rotation & 1;
+    p.w = p.swap ? img->h : img->w;
+    p.h = p.swap ? img->w : img->h;
+    p.rx = rev[img->rotation][0] != img->mirror;
+    p.ry = rev[img->rotation][1];
+    x = p.swap ? img->y : img->x;
+    y = p.swap ? img->x : img->y;
+    p.x = p.rx ? -(x + p.w * img->zoom) : x;
+    p.y = p.ry ? -(y + p.h * img->zoom) : y;
+    return p;
+}
+
+
+/* maps the pixels [*lo, *hi) onto the other direction of their axis, if rev */
+static void span_flip(bool rev, int *lo, int *hi)
+{
+    if (rev) {
+        int t = *lo;
+        *lo = -*hi;
+        *hi = -t;
     }
+}
 
-    win_clear(win);
 
-    imlib_context_set_image(img->im);
+/*
+ * Draws the part of src that is visible in the area x, y, w, h of the
+ * placement. src is either img->im, a mipmap level or a preview covering the
+ * whole image, or a tile of a tiled image, spanning px0, py0 to px1, py1 of it.
+ */
+static void img_render_part(SxivImage *img, const placement_t *p, Imlib_Image src,
+                            int px0, int py0, int px1, int py1, int x, int y, int w, int h)
+{
+    win_t *win = img->win;
+    int top = win->bar.top ? win->bar.h : 0;
+    int sx, sy, ex, ey, dx, dy, dw, dh, x0, x1, y0, y1;
+
+    imlib_context_set_image(src);
+    if (!img_map_span(p->x, img->zoom, px0, px1, imlib_image_get_width(), x, x + w,
+                      &sx, &ex, &dx, &dw) ||
+        !img_map_span(p->y, img->zoom, py0, py1, imlib_image_get_height(), y, y + h,
+                      &sy, &ey, &dy, &dh))
+    {
+        return;
+    }
     imlib_context_set_anti_alias(img->flags & IF_ANTI_ALIAS_ENABLED);
     imlib_context_set_drawable(win->buf.pm);
 
+    if (!imlib_image_has_alpha() && !img->mirror && img->rotation == 0 &&
+        img->gamma == 0 && img->brightness == 0 && img->contrast == 0)
+    {
+        imlib_render_image_part_on_drawable_at_size(sx, sy, ex - sx, ey - sy, dx, dy + top, dw, dh);
+        return;
+    }
     /* manual blending, for performance reasons.
      * see https://phab.enlightenment.org/T8969#156167 for more details.
+     * the alpha layer moves along with the image.
      */
-    if (imlib_image_has_alpha()) {
-        Imlib_Image bg = imlib_create_image(dw, dh);
-        if (bg == NULL) {
-            error_log(ENOMEM, "Failed to create image");
-            goto fallback;
-        }
-        imlib_context_set_image(bg);
-        imlib_image_set_has_alpha(0);
+    x0 = dx;
+    x1 = dx + dw;
+    y0 = dy;
+    y1 = dy + dh;
+    span_flip(p->rx, &x0, &x1);
+    span_flip(p->ry, &y0, &y1);
+    img_render_scaled(img, src, sx, sy, ex - sx, ey - sy, p->swap ? y0 : x0,
+                      (p->swap ? x0 : y0) + top, dw, dh, dx - ifloor(p->x), dy - ifloor(p->y));
+}
 
-        if (img->flags & IF_HAS_ALPHA_LAYER) {
-            const uint32_t col[2] = { 0xFF666666, 0xFF999999 };
-            uint32_t *data = imlib_image_get_data();
-
-            for (int row_offset = 0; row_offset < dh; row_offset++) {
-                int i = row_offset * dw;
-                if (row_offset == 0 || row_offset == 8) {
-                    for (int col_offset = 0; col_offset < dw; col_offset++)
-                    	data[i++] = col[!(col_offset & 8) ^ !row_offset];
-                } else {
-                    memcpy(&data[i], &data[(row_offset & 8) * dw], dw * sizeof(data[0]));
-                }
-            }
-            imlib_image_put_back_data(data);
-        } else {
-            XColor c = win->win_bg;
-            imlib_context_set_color(c.red >> 8, c.green >> 8, c.blue >> 8, 0xFF);
-            imlib_image_fill_rectangle(0, 0, dw, dh);
+
+/* draws the tiles of the given level that intersect the area x, y, w, h of the placement */
+static void img_render_tiles(SxivImage *img, const placement_t *p, int level,
+                             int x, int y, int w, int h)
+{
+    int step = 1 << level, span = TILE_SIZE << level;
+    int tx0 = MAX(0, (int)((x - p->x) / img->zoom) / span);
+    int ty0 = MAX(0, (int)((y - p->y) / img->zoom) / span);
+    int tx1 = MIN((p->w - 1) / span, (int)((x + w - p->x) / img->zoom) / span);
+    int ty1 = MIN((p->h - 1) / span, (int)((y + h - p->y) / img->zoom) / span);
+
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            Imlib_Image tile = tiled_get_tile(img->tiled, level, tx, ty);
+            int x0 = tx * span, y0 = ty * span;
+
+            if (tile == NULL)
+                continue;
+            imlib_context_set_image(tile);
+            img_render_part(img, p, tile, x0, y0, MIN(x0 + imlib_image_get_width() * step, p->w),
+                            MIN(y0 + imlib_image_get_height() * step, p->h), x, y, w, h);
         }
-        imlib_context_set_blend(1);
-        imlib_context_set_operation(IMLIB_OP_COPY);
-        imlib_blend_image_onto_image(img->im, 0, sx, sy, sw, sh, 0, 0, dw, dh);
-        imlib_context_set_color_modifier(NULL);
-        imlib_render_image_on_drawable(dx, dy);
-        imlib_free_image();
-        imlib_context_set_color_modifier(img->cmod);
+    }
+}
+
+
+/* draws the part of the image that is visible in the window area x, y, w, h */
+static void img_render_area(SxivImage *img, Imlib_Image src, int level, int x, int y, int w, int h)
+{
+    placement_t p = img_placement(img);
+    int x0 = x, x1 = x + w, y0 = y, y1 = y + h;
+
+    if (w <= 0 || h <= 0)
+        return;
+    if (p.swap) {
+        x0 = y;
+        x1 = y + h;
+        y0 = x;
+        y1 = x + w;
+    }
+    span_flip(p.rx, &x0, &x1);
+    span_flip(p.ry, &y0, &y1);
+    if (level >= 0)
+        img_render_tiles(img, &p, level, x0, y0, x1 - x0, y1 - y0);
+    else
+        img_render_part(img, &p, src, 0, 0, p.w, p.h, x0, y0, x1 - x0, y1 - y0);
+}
+
+
+static ImageView img_view(const SxivImage *img)
+{
+    const win_t *win = img->win;
+
+    return (ImageView) {
+        .x = img->x, .y = img->y, .zoom = img->zoom,
+        .w = win->w, .h = win->h, .top = win->bar.top ? win->bar.h : 0,
+        .flags = img->flags & (IF_ANTI_ALIAS_ENABLED | IF_HAS_ALPHA_LAYER),
+        .gamma = img->gamma, .brightness = img->brightness, .contrast = img->contrast,
+        .mirror = img->mirror, .rotation = img->rotation
+    };
+}
+
+
+/* true if renderings at the two views only differ in their position */
+static bool view_moved(const ImageView *v1, const ImageView *v2)
+{
+    return v1->zoom == v2->zoom && v1->w == v2->w && v1->h == v2->h &&
+           v1->top == v2->top && v1->flags == v2->flags && v1->gamma == v2->gamma &&
+           v1->brightness == v2->brightness && v1->contrast == v2->contrast &&
+           v1->mirror == v2->mirror && v1->rotation == v2->rotation;
+}
+
+
+/*
+ * Returns true if what img_render() drew last is still in win->buf.pm, or
+ * could be put back, and only needs to be moved by dx, dy to be up to date.
+ */
+static bool img_reuse_drawn(const SxivImage *img, Imlib_Image src, const ImageView *view,
+                            int *dx, int *dy)
+{
+    win_t *win = img->win;
+    float fx = view->x - img->drawn.view.x, fy = view->y - img->drawn.view.y;
+
+    if (img->drawn.src == NULL || img->drawn.src != src || !view_moved(view, &img->drawn.view))
+        return false;
+    /* fractional moves would change which pixels are drawn where */
+    *dx = (int)fx;
+    *dy = (int)fy;
+    if (fx != *dx || fy != *dy)
+        return false;
+    /* the buffer got cleared for something else in between */
+    return img->drawn.gen == win->buf.gen || win_restore(win, img->drawn.gen);
+}
+
+
+/*
+ * Puts the selected frame of an animation into the window as it was rendered
+ * before, if the view didn't change since then.
+ */
+static bool anim_render_pixmap(SxivImage *img, const ImageView *view)
+{
+    ImageFrameSet *m = &img->multi;
+
+    if (m->pm_size > 0 && (m->view.x != view->x || m->view.y != view->y ||
+                           !view_moved(&m->view, view)))
+    {
+        anim_free_pixmaps(img);
+    }
+    m->view = *view;
+    if (m->frames[m->sel].pm == None)
+        return false;
+    win_put_snapshot(img->win, m->frames[m->sel].pm);
+    /* not the content the next img_render() could move around */
+    img->drawn.src = NULL;
+    return true;
+}
+
+
+static void anim_keep_pixmap(SxivImage *img)
+{
+    ImageFrameSet *m = &img->multi;
+    size_t size = (size_t)img->win->w * img->win->h * sizeof(uint32_t);
+
+    if (m->frames[m->sel].pm == None && m->pm_size + size <= (size_t)ANIM_PIXMAP_SIZE << 20) {
+        m->frames[m->sel].pm = win_snapshot(img->win);
+        m->pm_size += size;
+    }
+}
+
+
+void img_render(SxivImage *img)
+{
+    img_fit(img);
+
+    if (img->flags & IF_CHECKPAN) {
+        img_check_pan(img, false);
+        img->flags &= ~IF_CHECKPAN;
+    }
+
+    if (!(img->flags & IF_IS_DIRTY))
+        return;
+
+    win_t *win = img->win;
+    Imlib_Image src = img->im;
+    ImageView view = img_view(img);
+    int level = -1, dx, dy;
+    long long t = stats_now();
+
+    /* what is in the buffer now gets drawn over */
+    win_unsave(win);
+    if (img->multi.cnt > 0 && anim_render_pixmap(img, &view)) {
+        img->flags &= ~IF_IS_DIRTY;
+        stats_add(STAT_IMG_RENDER, t);
+        return;
+    }
+
+    if (img->tiled != NULL) {
+        /* the overview is only good enough when it isn't upscaled */
+        int l = 0;
+        imlib_context_set_image(img->im);
+        while ((TILE_SIZE << l) < MAX(img->w, img->h) && img->zoom * (2 << l) <= 1.0f)
+            l++;
+        if (imlib_image_get_width() * (1 << l) < (img->rotation & 1 ? img->h : img->w))
+            level = l;
+    } else if (!(img->flags & IF_IS_PREVIEW) && img->multi.cnt == 0 &&
+               (img->flags & IF_ANTI_ALIAS_ENABLED) && img->zoom <= 0.5f)
+    {
+        /* when zoomed out with anti-aliasing, sample from the smallest mipmap
+         * level that is still at least as big as the result */
+        int l = 0;
+        while (l < MIPMAP_LEVELS && img->zoom * (2 << l) <= 1.0f)
+            l++;
+        src = img_mipmap(img, l);
+    }
+
+    if (img_reuse_drawn(img, src, &view, &dx, &dy)) {
+        /* render the uncovered strips only */
+        win_shift(win, dx, dy);
+        int x = dx > 0 ? 0 : (int)win->w + dx, w = ABS(dx);
+        int y = dy > 0 ? 0 : (int)win->h + dy, h = ABS(dy);
+        img_render_area(img, src, level, x, 0, w, win->h);
+        img_render_area(img, src, level, dx > 0 ? dx : 0, y, (int)win->w - w, h);
     } else {
-fallback:
-        imlib_render_image_part_on_drawable_at_size(sx, sy, sw, sh, dx, dy, dw, dh);
+        win_clear(win);
+        img_render_area(img, src, level, 0, 0, win->w, win->h);
     }
+    imlib_context_set_image(img->im);
+
+    img->drawn.src = src;
+    img->drawn.view = view;
+    img->drawn.gen = win->buf.gen;
+    win_save(win);
     img->flags &= ~IF_IS_DIRTY;
+    if (img->multi.cnt > 0)
+        anim_keep_pixmap(img);
+    stats_add(STAT_IMG_RENDER, t);
 }
 
 
@@ -667,15 +1908,7 @@ bool img_pan_edge(SxivImage *img, direction_t dir)
 
 void img_rotate(SxivImage *img, degree_t d)
 {
-    imlib_context_set_image(img->im);
-    imlib_image_orientate(d);
-
-    for (size_t i = 0; i < img->multi.cnt; i++) {
-        if (i != img->multi.sel) {
-            imlib_context_set_image(img->multi.frames[i].im);
-            imlib_image_orientate(d);
-        }
-    }
+    img->rotation = (img->rotation + d) % 4;
     if (d == DEGREE_90 || d == DEGREE_270) {
         float ox = d == DEGREE_90  ? img->x : img->win->w - img->x - img->w * img->zoom;
         float oy = d == DEGREE_270 ? img->y : img->win->h - img->y - img->h * img->zoom;
@@ -688,33 +1921,28 @@ void img_rotate(SxivImage *img, degree_t d)
         img->h = tmp;
         img->flags |= IF_CHECKPAN;
     }
-    img->flags |= IF_IS_DIRTY;
+    img->flags |= IF_IS_DIRTY | IF_IS_MODIFIED;
 }
 
 
 void img_flip(SxivImage *img, flipdir_t d)
 {
-    void (*imlib_flip_op[3])(void) = {
-        imlib_image_flip_horizontal,
-        imlib_image_flip_vertical,
-        imlib_image_flip_diagonal
-    };
-
     d = (d & (FLIP_HORIZONTAL | FLIP_VERTICAL)) - 1;
 
-    if (d < 0 || d >= ARRLEN(imlib_flip_op))
+    if (d < 0 || d > 2)
         return;
-
-    imlib_context_set_image(img->im);
-    imlib_flip_op[d]();
-
-    for (unsigned int i = 0; i < img->multi.cnt; i++) {
-        if (i != img->multi.sel) {
-            imlib_context_set_image(img->multi.frames[i].im);
-            imlib_flip_op[d]();
-        }
+    /* flipping a rotated image is the same as rotating the flipped image the
+     * other way. a vertical flip is a horizontal one rotated by 180 degrees,
+     * a diagonal one rotated by 270 degrees */
+    img->mirror = !img->mirror;
+    img->rotation = ((int[]){ 4, 6, 7 }[d] - img->rotation) % 4;
+    if (d == 2) {
+        int tmp = img->w;
+        img->w = img->h;
+        img->h = tmp;
+        img->flags |= IF_CHECKPAN;
     }
-    img->flags |= IF_IS_DIRTY;
+    img->flags |= IF_IS_DIRTY | IF_IS_MODIFIED;
 }
 
 
@@ -733,17 +1961,31 @@ static double steps_to_range(int d, double max, double offset)
 }
 
 
+/*
+ * Builds the table that img_render() maps the color channels through, the
+ * same way Imlib2's color modifiers do. cmod gets the same table, for the
+ * thumbnails.
+ */
 void img_update_color_modifiers(SxivImage *img)
 {
+    uint8_t alpha[256];
+    double gamma = 1.0 / steps_to_range(img->gamma, GAMMA_MAX, 1.0);
+    int brightness = steps_to_range(img->brightness, BRIGHTNESS_MAX, 0.0) * 255;
+    double contrast = steps_to_range(img->contrast, CONTRAST_MAX, 1.0);
+
+    for (int i = 0; i < 256; i++) {
+        int v = i;
+        if (img->gamma != 0)
+            v = MIN(MAX((int)(pow(v / 255.0, gamma) * 255), 0), 255);
+        if (img->brightness != 0)
+            v = MIN(MAX(v + brightness, 0), 255);
+        if (img->contrast != 0)
+            v = MIN(MAX((int)((v - 127) * contrast) + 127, 0), 255);
+        img->lut[i] = v;
+        alpha[i] = i;
+    }
     assert(imlib_context_get_color_modifier() == img->cmod);
-    imlib_reset_color_modifier();
-
-    if (img->gamma != 0)
-        imlib_modify_color_modifier_gamma(steps_to_range(img->gamma, GAMMA_MAX, 1.0));
-    if (img->brightness != 0)
-        imlib_modify_color_modifier_brightness(steps_to_range(img->brightness, BRIGHTNESS_MAX, 0.0));
-    if (img->contrast != 0)
-        imlib_modify_color_modifier_contrast(steps_to_range(img->contrast, CONTRAST_MAX, 1.0));
+    imlib_set_color_modifier_tables(img->lut, img->lut, img->lut, alpha);
 
     img->flags |= IF_IS_DIRTY;
 }
@@ -764,15 +2006,24 @@ bool img_change_color_modifier(SxivImage *img, int d, int *target)
 
 static bool img_frame_goto(SxivImage *img, int n)
 {
-    if (n < 0 || (unsigned int)n >= img->multi.cnt || (unsigned int)n == img->multi.sel)
+    ImageFrameSet *m = &img->multi;
+
+    if (n < 0 || (unsigned int)n >= m->cnt || (unsigned int)n == m->sel)
         return false;
 
-    img->multi.sel = n;
-    img->im = img->multi.frames[n].im;
+#if HAVE_IMLIB2_MULTI_FRAME
+    if (!anim_seek(img, n)) {
+        imlib_context_set_image(img->im);
+        return false;
+    }
+#endif
+    m->sel = n;
+    img->drawn.src = NULL;
 
     imlib_context_set_image(img->im);
-    img->w = imlib_image_get_width();
-    img->h = imlib_image_get_height();
+    /* the frame is unrotated, img->w and img->h are as shown */
+    img->w = img->rotation & 1 ? imlib_image_get_height() : imlib_image_get_width();
+    img->h = img->rotation & 1 ? imlib_image_get_width() : imlib_image_get_height();
     img->flags |= IF_CHECKPAN | IF_IS_DIRTY;
 
     return true;
@@ -791,9 +2042,63 @@ bool img_frame_navigate(SxivImage *img, int d)
 }
 
 
-bool img_frame_animate(SxivImage *img)
+/*
+ * Decodes the next frame of the current animation ahead of playback, if it
+ * isn't too far ahead. Meant to be called repeatedly while idle, returns
+ * false once there is nothing left to do.
+ */
+bool img_frame_decode(SxivImage *img)
+{
+#if HAVE_IMLIB2_MULTI_FRAME
+    ImageFrameSet *m = &img->multi;
+    unsigned int next;
+
+    if (m->dec == NULL)
+        return false;
+    if (m->dec->resident == m->cnt) {
+        /* everything fits, no need to ever decode again */
+        anim_decoder_free(m);
+        return false;
+    }
+    next = m->dec->next >= m->cnt ? 0 : m->dec->next;
+    if ((next + m->cnt - m->sel) % m->cnt >= m->keep)
+        return false;
+    anim_decode_next(img, NULL);
+    imlib_context_set_image(img->im);
+    return true;
+#else
+    (void)img;
+    return false;
+#endif
+}
+
+
+/* how long frame n is shown, estimated if it hasn't been decoded yet */
+unsigned int img_frame_delay(const SxivImage *img, unsigned int n)
+{
+    const ImageFrameSet *m = &img->multi;
+
+    if (n < m->cnt && m->frames[n].delay > 0)
+        return m->frames[n].delay;
+    return m->framedelay > 0 ? m->framedelay : DEF_ANIM_DELAY;
+}
+
+
+/* duration of a full loop, estimated for the frames that weren't decoded yet */
+int img_anim_length(const SxivImage *img)
+{
+    int length = 0;
+
+    for (unsigned int i = 0; i < img->multi.cnt; i++)
+        length += img_frame_delay(img, i);
+    return length;
+}
+
+
+/* advances the animation by n frames, wrapping around at its end */
+bool img_frame_animate(SxivImage *img, unsigned int n)
 {
     if (img->multi.cnt == 0)
         return false;
-    return img_frame_goto(img, (img->multi.sel + 1) % img->multi.cnt);
+    return img_frame_goto(img, (img->multi.sel + n) % img->multi.cnt);
 }
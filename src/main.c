@@ -19,6 +19,8 @@
 
 #include "autoreload.h"
 #include "cli_options.h"
+#include "dirwalk.h"
+#include "filesort.h"
 #include "image.h"
 #include "thumbs.h"
 #include "util.h"
@@ -26,6 +28,8 @@
 
 #define INCLUDE_MAPPINGS_CONFIG
 #include "commands.h"
+#include "stats.h"
+#include "trace.h"
 #include "config.h"
 
 #include <assert.h>
@@ -40,7 +44,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -51,14 +54,6 @@
 #define MODMASK(mask) (USED_MODMASK & (mask))
 #define BAR_SEP "  "
 
-#define TV_DIFF(t1,t2) (((t1)->tv_sec  - (t2)->tv_sec ) * 1000 + \
-                        ((t1)->tv_usec - (t2)->tv_usec) / 1000)
-#define TV_ADD_MSEC(tv, t)                  \
-    do {                                    \
-        (tv)->tv_sec  += (t) / 1000;        \
-        (tv)->tv_usec += (t) % 1000 * 1000; \
-    } while (0)
-
 
 typedef struct {
     int err;
@@ -84,13 +79,29 @@ const XButtonEvent *g_xbutton_ev;
 
 static void autoreload(void);
 
+/* backing storage for the name and path strings of g_files */
+static arena_t filenames;
+static int filecap;
+
+/* file list input that is still read after the window got opened */
+static struct {
+    int fd; /* stdin, -1 once exhausted */
+    char *buf;
+    size_t len, cap;
+    int argidx; /* next entry of g_options->filenames */
+} input = { .fd = -1 };
+
 static bool extprefix;
 static bool resized = false;
+static int direction = 1; /* of the last navigation in the file list */
+static int slideshow_armed; /* delay the slideshow timeout was set with */
 
 static struct {
     extcmd_t f, ft;
     int fd;
     pid_t pid;
+    const char *name; /* for trace_process(), as of when spawned */
+    long long spawned;
 } info, wintitle;
 
 static struct {
@@ -98,18 +109,17 @@ static struct {
     bool warned;
 } keyhandler;
 
+/*
+ * Animation playback: every frame has an absolute deadline on the monotonic
+ * clock, so that the time it takes to render doesn't add up over the frames.
+ * Frames that are overdue by the time the previous one is done are skipped.
+ */
 static struct {
-    timeout_f handler;
-    struct timeval when;
-    bool active;
-} timeouts[] = {
-    { .handler = autoreload   },
-    { .handler = redraw       },
-    { .handler = reset_cursor },
-    { .handler = slideshow    },
-    { .handler = animate      },
-    { .handler = clear_resize },
-};
+    struct timespec start;
+    struct timespec due;         /* of the frame after the selected one */
+    bool obscured;
+    bool unfocused;
+} anim;
 
 /*
  * function implementations
@@ -117,63 +127,103 @@ static struct {
 
 static void cleanup(void)
 {
+    anim_stop();
+    if (g_options->stats)
+        stats_dump();
     img_close(&g_img, false);
+    img_cache_free();
     autoreload_cleanup(&g_state_autoreload);
+    timeout_cleanup();
     tns_free(&g_tns);
     win_close(&g_win);
+    arena_free(&filenames);
+    free(input.buf);
+    trace_close();
 }
 
 
-static bool xgetline(char **lineptr, size_t *n)
+static void append_file(const char *name, size_t namelen,
+                        const char *path, size_t pathlen, fileflags_t flags)
 {
-    ssize_t len = getdelim(lineptr, n, g_options->using_null ? '\0' : '\n', stdin);
-    if (!g_options->using_null && len > 0 && (*lineptr)[len - 1] == '\n')
-        (*lineptr)[len - 1] = '\0';
-    return len > 0;
-}
+    fileinfo_t *file;
 
+    if (g_filecnt == filecap) {
+        filecap *= 2;
+        g_files = erealloc(g_files, filecap * sizeof(*g_files));
+    }
 
-static int fncmp(const void *a, const void *b)
-{
-    return strcoll(((fileinfo_t *)a)->name, ((fileinfo_t *)b)->name);
+    file = &g_files[g_filecnt++];
+    memset(file, 0, sizeof(*file));
+    file->name = arena_strndup(&filenames, name, namelen);
+    if (namelen == pathlen && memcmp(name, path, namelen) == 0)
+        file->path = file->name;
+    else
+        file->path = arena_strndup(&filenames, path, pathlen);
+    file->flags = flags;
+    if (g_tns.thumbs != NULL)
+        tns_grow(&g_tns, g_files);
 }
 
 
+/*
+ * Readability isn't checked here, unreadable files are dropped once
+ * img_open() or tns_load() fails on them.
+ */
 static void check_add_file(const char *filename, bool given)
 {
-    char *path;
+    char path[PATH_MAX];
 
     if (*filename == '\0')
         return;
 
-    if (access(filename, R_OK) < 0 ||
-        (path = realpath(filename, NULL)) == NULL)
-    {
+    if (realpath(filename, path) == NULL) {
         if (given)
             error_log(errno, "%s", filename);
         return;
     }
+    append_file(filename, strlen(filename), path, strlen(path), given ? FF_WARN : 0);
+}
 
-    if (g_fileidx == g_filecnt) {
-        g_filecnt *= 2;
-        g_files = erealloc(g_files, g_filecnt * sizeof(*g_files));
-        memset(&g_files[g_filecnt / 2], 0, g_filecnt / 2 * sizeof(*g_files));
-    }
 
-    g_files[g_fileidx].name = estrdup(filename);
-    g_files[g_fileidx].path = path;
-    if (given)
-        g_files[g_fileidx].flags |= FF_WARN;
-    g_fileidx++;
+/* adds the entries of a directory, without resolving each one of them */
+static void add_dir_entries(const dirwalk_dir_t *dir)
+{
+    char filename[PATH_MAX], path[PATH_MAX];
+    size_t dirlen = strlen(dir->path);
+    size_t reallen = strlen(dir->realpath);
+    bool dirslash = dir->path[dirlen - 1] != '/';
+    bool realslash = dir->realpath[reallen - 1] != '/';
+
+    if (dirlen >= sizeof(filename) || reallen >= sizeof(path))
+        return;
+    memcpy(filename, dir->path, dirlen);
+    filename[dirlen] = '/';
+    memcpy(path, dir->realpath, reallen);
+    path[reallen] = '/';
+
+    for (const char *entry = dir->names; entry < dir->names + dir->len; entry += strlen(entry) + 1) {
+        const char *name = entry + 1;
+        size_t namelen = strlen(name);
+        size_t len = dirlen + dirslash + namelen;
+
+        if (len >= sizeof(filename) || reallen + realslash + namelen >= sizeof(path))
+            continue;
+        memcpy(filename + dirlen + dirslash, name, namelen + 1);
+        if (*entry == DW_LINK) {
+            check_add_file(filename, false);
+        } else {
+            memcpy(path + reallen + realslash, name, namelen + 1);
+            append_file(filename, len, path, reallen + realslash + namelen, 0);
+        }
+    }
 }
 
 
 static void add_entry(const char *entry_name)
 {
     int start;
-    char *filename;
     struct stat fstats;
-    r_dir_t dir;
+    dirwalk_t walk;
 
     if (stat(entry_name, &fstats) < 0) {
         error_log(errno, "%s", entry_name);
@@ -181,20 +231,93 @@ static void add_entry(const char *entry_name)
     }
     if (!S_ISDIR(fstats.st_mode)) {
         check_add_file(entry_name, true);
-    } else {
-        if (r_opendir(&dir, entry_name, g_options->recursive) < 0) {
-            error_log(errno, "%s", entry_name);
+        return;
+    }
+    if (dirwalk(&walk, entry_name, g_options->recursive, true) < 0) {
+        error_log(errno, "%s", entry_name);
+        return;
+    }
+
+    start = g_filecnt;
+    for (const dirwalk_dir_t *dir = walk.dirs; dir != NULL; dir = dir->next)
+        add_dir_entries(dir);
+    dirwalk_free(&walk);
+    if (g_filecnt - start > 1)
+        filesort(g_files + start, g_filecnt - start, g_options->natural_sort);
+}
+
+
+static bool input_pending(void)
+{
+    return input.fd != -1 || input.argidx < g_options->filecnt;
+}
+
+
+/* true if fetch_input() would not block */
+static bool input_ready(void)
+{
+    struct pollfd pfd = { .fd = input.fd, .events = POLLIN };
+
+    if (input.fd == -1)
+        return input.argidx < g_options->filecnt;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+
+static void read_input(void)
+{
+    char delim = g_options->using_null ? '\0' : '\n';
+    char *entry, *end;
+    ssize_t n;
+
+    if (input.cap - input.len < BUFSIZ) {
+        input.cap = MAX(input.cap * 2, input.len + BUFSIZ);
+        input.buf = erealloc(input.buf, input.cap);
+    }
+    if ((n = read(input.fd, input.buf + input.len, input.cap - input.len - 1)) < 0) {
+        if (errno == EINTR || errno == EAGAIN)
             return;
-        }
-        start = g_fileidx;
-        while ((filename = r_readdir(&dir, true)) != NULL) {
-            check_add_file(filename, false);
-            free(filename);
-        }
-        r_closedir(&dir);
-        if (g_fileidx - start > 1)
-            qsort(g_files + start, g_fileidx - start, sizeof(*g_files), fncmp);
+        error_log(errno, "stdin");
+    }
+    if (n <= 0) {
+        /* the last entry doesn't need a delimiter */
+        input.buf[input.len] = '\0';
+        if (input.len > 0)
+            add_entry(input.buf);
+        free(input.buf);
+        input.buf = NULL;
+        input.len = input.cap = 0;
+        input.fd = -1;
+        return;
     }
+
+    input.len += n;
+    entry = input.buf;
+    while ((end = memchr(entry, delim, input.len - (entry - input.buf))) != NULL) {
+        *end = '\0';
+        add_entry(entry);
+        entry = end + 1;
+    }
+    input.len -= entry - input.buf;
+    memmove(input.buf, entry, input.len);
+}
+
+
+/*
+ * Adds the next chunk of the file list: whatever is available on stdin, or
+ * else the next command line argument. Blocks while stdin has nothing to read.
+ */
+static void fetch_input(void)
+{
+    int cnt = g_filecnt;
+
+    if (input.fd != -1)
+        read_input();
+    else if (input.argidx < g_options->filecnt)
+        add_entry(g_options->filenames[input.argidx++]);
+
+    if (g_filecnt > cnt && g_win.xwin != None)
+        set_timeout(redraw, TO_REDRAW_THUMBS, false);
 }
 
 
@@ -203,6 +326,8 @@ void remove_file(int n, bool manual)
     if (n < 0 || n >= g_filecnt)
         return;
 
+    while (g_filecnt == 1 && input_pending())
+        fetch_input();
     if (g_filecnt == 1) {
         if (!manual)
             fprintf(stderr, "%s: no more files to display, aborting\n", progname);
@@ -211,9 +336,7 @@ void remove_file(int n, bool manual)
     if (g_files[n].flags & FF_MARK)
         g_markcnt--;
 
-    if (g_files[n].path != g_files[n].name)
-        free((void *)g_files[n].path);
-    free((void *)g_files[n].name);
+    /* name and path stay in the arena until cleanup() */
     if (g_tns.thumbs != NULL)
         tns_unload(&g_tns, n);
 
@@ -235,72 +358,6 @@ void remove_file(int n, bool manual)
 }
 
 
-void set_timeout(timeout_f handler, int time, bool overwrite)
-{
-    unsigned int i;
-
-    for (i = 0; i < ARRLEN(timeouts); i++) {
-        if (timeouts[i].handler == handler) {
-            if (!timeouts[i].active || overwrite) {
-                gettimeofday(&timeouts[i].when, 0);
-                TV_ADD_MSEC(&timeouts[i].when, time);
-                timeouts[i].active = true;
-            }
-            return;
-        }
-    }
-}
-
-
-void reset_timeout(timeout_f handler)
-{
-    unsigned int i;
-
-    for (i = 0; i < ARRLEN(timeouts); i++) {
-        if (timeouts[i].handler == handler) {
-            timeouts[i].active = false;
-            return;
-        }
-    }
-}
-
-
-static bool check_timeouts(int *t)
-{
-    int i = 0, tdiff, tmin;
-    struct timeval now;
-
-    for (i = 0; i < (int)ARRLEN(timeouts); ++i) {
-        if (timeouts[i].active) {
-            // TODO: does this syscall **need** to be inside a loop?
-            gettimeofday(&now, 0);
-            tdiff = TV_DIFF(&timeouts[i].when, &now);
-            if (tdiff <= 0) {
-                timeouts[i].active = false;
-                if (timeouts[i].handler != NULL)
-                    timeouts[i].handler();
-            }
-        }
-    }
-
-    tmin = INT_MAX;
-    // TODO: would it be innaproppriate to just call this at the top of the
-    // function (so that we may call it only a single time... [thinking
-    // about the loop above])
-    gettimeofday(&now, 0);
-    for (i = 0; i < (int)ARRLEN(timeouts); ++i) {
-        if (timeouts[i].active) {
-            tdiff = TV_DIFF(&timeouts[i].when, &now);
-            tmin = MIN(tmin, tdiff);
-        }
-    }
-
-    if (tmin != INT_MAX && t != NULL)
-        *t = MAX(tmin, 0);
-    return tmin != INT_MAX;
-}
-
-
 static void autoreload(void)
 {
     if (g_img.flags & IF_IS_AUTORELOAD_PENDING) {
@@ -326,6 +383,8 @@ static void kill_close(pid_t pid, int *fd)
 
 static void close_title(void)
 {
+    if (wintitle.fd != -1)
+        trace_process(wintitle.name, wintitle.pid, wintitle.spawned);
     kill_close(wintitle.pid, &wintitle.fd);
 }
 
@@ -361,12 +420,16 @@ static void open_title(void)
     snprintf(fcnt, ARRLEN(fcnt), "%d", g_filecnt);
     construct_argv(argv, ARRLEN(argv), wintitle.f.cmd, g_files[g_fileidx].path,
                    fidx, fcnt, w, h, z, NULL);
+    wintitle.name = "win-title";
+    wintitle.spawned = trace_start();
     wintitle.pid = spawn(&wintitle.fd, NULL, O_NONBLOCK, argv);
 }
 
 
 void close_info(void)
 {
+    if (info.fd != -1)
+        trace_process(info.name, info.pid, info.spawned);
     kill_close(info.pid, &info.fd);
 }
 
@@ -386,6 +449,8 @@ void open_info(void)
     }
     construct_argv(argv, ARRLEN(argv), cmd, g_files[g_fileidx].name, w, h,
                    g_files[g_fileidx].path, NULL);
+    info.name = g_mode == MODE_IMAGE ? "image-info" : "thumb-info";
+    info.spawned = trace_start();
     info.pid = spawn(&info.fd, NULL, O_NONBLOCK, argv);
 }
 
@@ -408,10 +473,19 @@ static void read_info(void)
 }
 
 
+static bool load_preview(int n)
+{
+    Imlib_Image preview = tns_cache_peek(&g_files[n]);
+
+    return preview != NULL && img_load_preview(&g_img, &g_files[n], preview);
+}
+
+
 void load_image(int new)
 {
     bool prev = new < g_fileidx;
     static int current;
+    static const char *shown; /* path of the file decoded in g_img */
 
     if (new < 0 || new >= g_filecnt)
         return;
@@ -420,29 +494,55 @@ void load_image(int new)
         win_set_cursor(&g_win, CURSOR_WATCH);
     reset_timeout(autoreload);
     reset_timeout(slideshow);
+    anim_stop();
 
     if (new != current) {
         g_alternate = current;
+        direction = prev ? -1 : 1;
         g_img.flags &= ~IF_IS_AUTORELOAD_PENDING;
     }
 
-    img_close(&g_img, false);
-    while (!img_load(&g_img, &g_files[new])) {
+    /* reloading the same file has to decode it afresh */
+    if (g_img.im != NULL && shown != g_files[new].path)
+        img_cache_store(&g_img, shown);
+    else
+        img_close(&g_img, false);
+    while (!img_cache_load(&g_img, &g_files[new]) && !load_preview(new) &&
+           !img_load(&g_img, &g_files[new]))
+    {
         remove_file(new, false);
         if (new >= g_filecnt)
             new = g_filecnt - 1;
         else if (new > 0 && prev)
             new -= 1;
     }
-    g_files[new].flags &= ~FF_WARN;
+    if (!(g_img.flags & IF_IS_PREVIEW))
+        g_files[new].flags &= ~FF_WARN;
     g_fileidx = current = new;
+    shown = g_files[new].path;
 
     autoreload_add(&g_state_autoreload, g_files[g_fileidx].path);
+    anim_start();
+}
 
-    if (g_img.multi.cnt > 0 && g_img.multi.animate)
-        set_timeout(animate, g_img.multi.frames[g_img.multi.sel].delay, true);
-    else
-        reset_timeout(animate);
+
+/* replaces the preview shown by load_image() with the decoded image */
+void finish_preview(void)
+{
+    if (!(g_img.flags & IF_IS_PREVIEW))
+        return;
+
+    win_set_cursor(&g_win, CURSOR_WATCH);
+    img_free(g_img.im, false);
+    g_img.im = NULL;
+    if (!img_load(&g_img, &g_files[g_fileidx])) {
+        g_img.flags &= ~IF_IS_PREVIEW;
+        remove_file(g_fileidx, false);
+        load_image(g_fileidx);
+        return;
+    }
+    g_files[g_fileidx].flags &= ~FF_WARN;
+    anim_start();
 }
 
 
@@ -567,15 +667,24 @@ int nav_button(void)
 }
 
 
+/* how long an image is shown, animations at least for a full loop */
+static int slideshow_delay(void)
+{
+    int t = g_img.slideshow_settings.delay * 100;
+
+    if (g_img.multi.cnt > 0 && g_img.multi.animate)
+        t = MAX(t, img_anim_length(&g_img));
+    return t;
+}
+
+
 void redraw(void)
 {
     if (g_mode == MODE_IMAGE) {
         img_render(&g_img);
-        if (g_img.slideshow_settings.is_enabled) {
-            int t = g_img.slideshow_settings.delay * 100;
-            if (g_img.multi.cnt > 0 && g_img.multi.animate)
-                t = MAX(t, g_img.multi.length);
-            set_timeout(slideshow, t, false);
+        if (g_img.slideshow_settings.is_enabled && !timeout_active(slideshow)) {
+            slideshow_armed = slideshow_delay();
+            set_timeout(slideshow, slideshow_armed, false);
         }
     } else {
         tns_render(&g_tns);
@@ -597,32 +706,145 @@ void reset_cursor(void)
     }
 
     cursor_t cursor = CURSOR_NONE;
-    for (uint32_t i = 0; i < ARRLEN(timeouts); i++) {
-        if (timeouts[i].handler == reset_cursor) {
-            if (timeouts[i].active) {
-                int c = nav_button();
-                c = MAX(g_fileidx > 0 ? 0 : 1, c);
-                c = MIN(g_fileidx + 1 < g_filecnt ? 2 : 1, c);
-                cursor = imgcursor[c];
-            }
-            break;
-        }
+    if (timeout_active(reset_cursor)) {
+        int c = nav_button();
+        c = MAX(g_fileidx > 0 ? 0 : 1, c);
+        c = MIN(g_fileidx + 1 < g_filecnt ? 2 : 1, c);
+        cursor = imgcursor[c];
     }
     win_set_cursor(&g_win, cursor);
 }
 
 
+static long long ts_diff_ns(const struct timespec *t1, const struct timespec *t2)
+{
+    return (t1->tv_sec - t2->tv_sec) * 1000000000LL + (t1->tv_nsec - t2->tv_nsec);
+}
+
+
+static void ts_add_ms(struct timespec *t, unsigned int ms)
+{
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += ms % 1000 * 1000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+
+/* arms the timeout for the next frame, no earlier than its deadline */
+static void anim_schedule(const struct timespec *now, int min_delay)
+{
+    long long ns = ts_diff_ns(&anim.due, now);
+    int delay = ns > 0 ? (ns + 999999) / 1000000 : 0;
+
+    set_timeout(animate, MAX(delay, min_delay), true);
+}
+
+
+static bool anim_idle(void)
+{
+    return g_options->idle_framerate > 0 && (anim.obscured || anim.unfocused);
+}
+
+
+/* starts playing the current image from its selected frame, if it should */
+void anim_start(void)
+{
+    anim_stop();
+    if (g_img.multi.cnt == 0 || !g_img.multi.animate)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &anim.start);
+    anim.due = anim.start;
+    ts_add_ms(&anim.due, img_frame_delay(&g_img, g_img.multi.sel));
+    anim_schedule(&anim.start, 0);
+}
+
+
+void anim_stop(void)
+{
+    struct timespec now;
+
+    if (timeout_active(animate)) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats_count(COUNT_ANIM_PLAYED_MS, ts_diff_ns(&now, &anim.start) / 1000000);
+    }
+    reset_timeout(animate);
+}
+
+
 void animate(void)
 {
-    if (img_frame_animate(&g_img)) {
-        set_timeout(animate, g_img.multi.frames[g_img.multi.sel].delay, true);
+    ImageFrameSet *m = &g_img.multi;
+    struct timespec now, due;
+    unsigned int n = 1, sel, delay;
+
+    if (m->cnt == 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sel = (m->sel + 1) % m->cnt;
+    delay = img_frame_delay(&g_img, sel);
+    due = anim.due;
+    ts_add_ms(&due, delay);
+    /* the frames whose successor is due already won't be seen anyway */
+    while (ts_diff_ns(&due, &now) <= 0 && n < m->cnt) {
+        stats_count(COUNT_ANIM_NOMINAL_MS, delay);
+        anim.due = due;
+        sel = (sel + 1) % m->cnt;
+        delay = img_frame_delay(&g_img, sel);
+        ts_add_ms(&due, delay);
+        n++;
+    }
+    stats_count(COUNT_ANIM_NOMINAL_MS, delay);
+    if (ts_diff_ns(&due, &now) <= 0) {
+        /* more than a whole loop behind, e.g. after a suspend */
+        due = now;
+        ts_add_ms(&due, delay);
+    }
+    anim.due = due;
+    stats_count(anim_idle() ? COUNT_ANIM_THROTTLED : COUNT_ANIM_DROPPED, n - 1);
+
+    if (img_frame_animate(&g_img, n)) {
+        stats_count(COUNT_ANIM_SHOWN, 1);
         redraw();
     }
+    if (anim_idle()) {
+        struct timespec done;
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        anim_schedule(&done, 1000 / g_options->idle_framerate -
+                             ts_diff_ns(&done, &now) / 1000000);
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        anim_schedule(&now, 0);
+    }
+}
+
+
+/* catches up with the animation once the window isn't idle anymore */
+static void anim_set_idle(bool *state, bool idle)
+{
+    struct timespec now;
+    bool was_idle = anim_idle();
+
+    *state = idle;
+    if (was_idle && !anim_idle() && timeout_active(animate)) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        anim_schedule(&now, 0);
+    }
 }
 
 
 void slideshow(void)
 {
+    int t = slideshow_delay();
+
+    /* the delays of frames decoded since then made the loop longer */
+    if (t > slideshow_armed) {
+        set_timeout(slideshow, t - slideshow_armed, true);
+        slideshow_armed = t;
+        return;
+    }
     load_image(g_fileidx + 1 < g_filecnt ? g_fileidx + 1 : 0);
     redraw();
 }
@@ -665,6 +887,7 @@ static bool run_key_handler(const char *key, unsigned int mask)
     pid_t pid;
     int writefd, f, i;
     int fcnt = marked ? g_markcnt : 1;
+    long long t;
     char kstr[32];
     struct stat *oldst, st;
     XEvent dump;
@@ -690,6 +913,7 @@ static bool run_key_handler(const char *key, unsigned int mask)
              mask & Mod1Mask    ? "M-" : "",
              mask & ShiftMask   ? "S-" : "", key);
     construct_argv(argv, ARRLEN(argv), keyhandler.f.cmd, kstr, NULL);
+    t = trace_start();
     if ((pid = spawn(NULL, &writefd, 0x0, argv)) < 0)
         return false;
     if ((pfs = fdopen(writefd, "w")) == NULL) {
@@ -709,6 +933,7 @@ static bool run_key_handler(const char *key, unsigned int mask)
     fclose(pfs);
     while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
         ;
+    trace_process("key-handler", pid, t);
 
     for (f = i = 0; f < fcnt; i++) {
         if ((marked && (g_files[i].flags & FF_MARK)) || (!marked && i == g_fileidx)) {
@@ -818,13 +1043,18 @@ static void on_buttonpress(const XButtonEvent *bev)
 static void run(void)
 {
     int32_t timeout = 0;
+    long long iteration = 0, t;
     XEvent ev;
     g_xbutton_ev = &ev.xbutton;
 
     while (true) {
+        trace_span("run", iteration, NULL);
+        iteration = trace_start();
+        stats_check();
         bool to_set = check_timeouts(&timeout);
         bool should_init_thumb = g_mode == MODE_THUMB && g_tns.next_to_init < g_filecnt;
         bool should_load_thumb = g_mode == MODE_THUMB && g_tns.next_to_load_in_view < g_tns.visible_thumbs.end;
+        bool should_fetch_input = input_ready();
 
         // "Only do heavy processing while there are no events to process"
         if (XPending(g_win.env.dpy) == 0) {
@@ -840,26 +1070,54 @@ static void run(void)
                 }
                 continue;
             }
+            if (should_fetch_input) {
+                fetch_input();
+                continue;
+            }
             if (should_init_thumb) {
                 set_timeout(redraw, TO_REDRAW_THUMBS, false);
                 if (!tns_load(&g_tns, g_tns.next_to_init, false, true))
                     remove_file(g_tns.next_to_init, false);
                 continue;
             }
-            if (to_set || info.fd != -1 || g_state_autoreload.fd != -1) {
-                enum { FD_X, FD_INFO, FD_TITLE, FD_ARL, FD_CNT };
+            /* decode only once the current image or its preview is on screen */
+            if (g_mode == MODE_IMAGE && (g_img.flags & IF_IS_PREVIEW) && !timeout_active(redraw)) {
+                finish_preview();
+                redraw();
+                continue;
+            }
+            if (g_mode == MODE_IMAGE && img_frame_decode(&g_img))
+                continue;
+            if (g_mode == MODE_IMAGE && !timeout_active(redraw) &&
+                img_prefetch(&g_img, g_fileidx, direction))
+            {
+                continue;
+            }
+            /* poll(2), unlike XNextEvent(), returns when a signal for --stats arrives */
+            if (to_set || info.fd != -1 || g_state_autoreload.fd != -1 || input.fd != -1 ||
+                g_options->stats)
+            {
+                enum { FD_X, FD_INFO, FD_TITLE, FD_ARL, FD_IN, FD_TIMER, FD_CNT };
                 // This needs to be reinitialized in every loop... might as well declare it here
                 struct pollfd pfd[FD_CNT];
+                int ready;
 
                 pfd[FD_X].fd = ConnectionNumber(g_win.env.dpy);
                 pfd[FD_INFO].fd = info.fd;
                 pfd[FD_TITLE].fd = wintitle.fd;
                 pfd[FD_ARL].fd = g_state_autoreload.fd;
+                pfd[FD_IN].fd = input.fd;
+                pfd[FD_TIMER].fd = timeout_fd();
 
-                pfd[FD_X].events = pfd[FD_ARL].events = POLLIN;
+                /* the timerfd needn't be read, check_timeouts() re-arms it */
+                pfd[FD_X].events = pfd[FD_ARL].events = pfd[FD_IN].events = POLLIN;
+                pfd[FD_TIMER].events = POLLIN;
                 pfd[FD_INFO].events = pfd[FD_TITLE].events = 0;
 
-                if (poll(pfd, ARRLEN(pfd), to_set ? timeout : -1) < 0)
+                t = trace_start();
+                ready = poll(pfd, ARRLEN(pfd), to_set ? timeout : -1);
+                trace_span("poll", t, NULL);
+                if (ready < 0)
                     continue;
                 if (pfd[FD_INFO].revents & POLLHUP)
                     read_info();
@@ -874,6 +1132,7 @@ static void run(void)
         }
 
         bool discard;
+        t = trace_start();
         do {
             XNextEvent(g_win.env.dpy, &ev);
             discard = false;
@@ -892,10 +1151,13 @@ static void run(void)
                 }
             }
         } while (discard);
+        trace_span("XNextEvent", t, NULL);
 
+        t = trace_start();
         switch (ev.type) {
         case ButtonPress:
             on_buttonpress(&ev.xbutton);
+            trace_span("on_buttonpress", t, NULL);
             break;
         case ClientMessage:
             if ((Atom)ev.xclient.data.l[0] == atoms[ATOM_WM_DELETE_WINDOW])
@@ -923,6 +1185,7 @@ static void run(void)
             break;
         case KeyPress:
             on_keypress(&ev.xkey);
+            trace_span("on_keypress", t, NULL);
             break;
         case MotionNotify:
             if (g_mode == MODE_IMAGE) {
@@ -930,6 +1193,14 @@ static void run(void)
                 reset_cursor();
             }
             break;
+        case VisibilityNotify:
+            anim_set_idle(&anim.obscured, ev.xvisibility.state == VisibilityFullyObscured);
+            break;
+        case FocusIn:
+        case FocusOut:
+            if (ev.xfocus.detail != NotifyPointer)
+                anim_set_idle(&anim.unfocused, ev.type == FocusOut);
+            break;
         }
     }
 }
@@ -960,6 +1231,10 @@ int main(int argc, char *argv[])
 
     parse_options(argc, argv);
 
+    if (g_options->stats)
+        setup_signal(SIGUSR1, stats_request, 0);
+    trace_init();
+
     if (g_options->clean_cache) {
         tns_init(&g_tns, NULL, NULL, NULL, NULL);
         tns_clean_cache();
@@ -972,28 +1247,26 @@ int main(int argc, char *argv[])
     }
 
     if (g_options->recursive || g_options->from_stdin)
-        g_filecnt = 1024;
+        filecap = 1024;
     else
-        g_filecnt = g_options->filecnt;
+        filecap = MAX(g_options->filecnt, 1);
 
-    g_files = ecalloc(g_filecnt, sizeof(*g_files));
-    g_fileidx = 0;
+    g_files = emalloc(filecap * sizeof(*g_files));
+    g_filecnt = g_fileidx = 0;
 
-    if (g_options->from_stdin) {
-        char *filename = NULL;
-        n = 0;
-        while (xgetline(&filename, &n))
-            add_entry(filename);
-        free(filename);
+    /* only wait for the files needed to show the first image, the rest of the
+     * list is fetched by run(), except for the background cache process */
+    if (g_options->from_stdin)
+        input.fd = STDIN_FILENO;
+    while (input_pending() &&
+           (g_filecnt <= g_options->startnum || g_options->background_cache))
+    {
+        fetch_input();
     }
 
-    for (i = 0; i < g_options->filecnt; i++)
-        add_entry(g_options->filenames[i]);
-
-    if (g_fileidx == 0)
+    if (g_filecnt == 0)
         error_quit(EXIT_FAILURE, 0, "No valid image file given, aborting");
 
-    g_filecnt = g_fileidx;
     g_fileidx = g_options->startnum < g_filecnt ? g_options->startnum : 0;
 
     if (g_options->background_cache && !g_options->private_mode) {
@@ -58,12 +58,18 @@ static void print_version(void)
 #if HAVE_INOTIFY
         "+inotify "
 #endif
+#if HAVE_TIMERFD
+        "+timerfd "
+#endif
 #if HAVE_LIBFONTS
         "+statusbar "
 #endif
 #if HAVE_LIBEXIF
         "+exif "
 #endif
+#if HAVE_LIBTIFF
+        "+tiff "
+#endif
 #if HAVE_IMLIB2_MULTI_FRAME
         "+multiframe "
 #endif
@@ -79,7 +85,11 @@ void parse_options(int argc, char **argv)
         OPT_START = UCHAR_MAX,
         OPT_AA,
         OPT_AL,
-        OPT_BG
+        OPT_BG,
+        OPT_NS,
+        OPT_IC,
+        OPT_IF,
+        OPT_ST
     };
     static const struct optparse_long longopts[] = {
         { "framerate",      'A',     OPTPARSE_REQUIRED },
@@ -107,6 +117,10 @@ void parse_options(int argc, char **argv)
         { "null",           '0',     OPTPARSE_NONE },
         { "anti-alias",    OPT_AA,   OPTPARSE_OPTIONAL },
         { "alpha-layer",   OPT_AL,   OPTPARSE_OPTIONAL },
+        { "natural-sort",  OPT_NS,   OPTPARSE_OPTIONAL },
+        { "image-cache",   OPT_IC,   OPTPARSE_REQUIRED },
+        { "idle-framerate", OPT_IF,  OPTPARSE_REQUIRED },
+        { "stats",         OPT_ST,   OPTPARSE_OPTIONAL },
         /* TODO: document this when it's stable */
         { "bg-cache",      OPT_BG,   OPTPARSE_OPTIONAL },
         { 0 }, /* end */
@@ -124,6 +138,7 @@ void parse_options(int argc, char **argv)
     _options.to_stdout = false;
     _options.using_null = false;
     _options.recursive = false;
+    _options.natural_sort = NATURAL_SORT;
     _options.startnum = 0;
 
     _options.scalemode = SCALE_DOWN;
@@ -132,8 +147,12 @@ void parse_options(int argc, char **argv)
     _options.alpha_layer = ALPHA_LAYER;
     _options.animate = false;
     _options.gamma = 0;
+    _options.image_cache = IMAGE_CACHE_SIZE;
     _options.slideshow = 0;
     _options.framerate = 0;
+    _options.idle_framerate = IDLE_FRAMERATE;
+    _options.stats = false;
+    _options.stats_file = NULL;
 
     _options.fullscreen = false;
     _options.embed = 0;
@@ -270,6 +289,27 @@ void parse_options(int argc, char **argv)
                 error_quit(EXIT_FAILURE, 0, "Invalid argument for option --bg-cache: %s", op.optarg);
             _options.background_cache = op.optarg == NULL;
             break;
+        case OPT_NS:
+            if (op.optarg != NULL && !STREQ(op.optarg, "no"))
+                error_quit(EXIT_FAILURE, 0, "Invalid argument for option --natural-sort: %s", op.optarg);
+            _options.natural_sort = op.optarg == NULL;
+            break;
+        case OPT_IC:
+            n = strtol(op.optarg, &end, 0);
+            if (*end != '\0' || n < 0 || n > INT_MAX)
+                error_quit(EXIT_FAILURE, 0, "Invalid image cache size: %s", op.optarg);
+            _options.image_cache = n;
+            break;
+        case OPT_IF:
+            n = strtol(op.optarg, &end, 0);
+            if (*end != '\0' || n < 0 || n > INT_MAX)
+                error_quit(EXIT_FAILURE, 0, "Invalid idle framerate: %s", op.optarg);
+            _options.idle_framerate = n;
+            break;
+        case OPT_ST:
+            _options.stats = true;
+            _options.stats_file = op.optarg;
+            break;
         }
     }
 
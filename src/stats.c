@@ -0,0 +1,214 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include "nsxiv.h"
+#include "cli_options.h"
+#include "trace.h"
+#include "util.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+
+extern opt_t *g_options;
+
+enum {
+    SUB_BITS = 2,
+    SUB_BUCKETS = 1 << SUB_BITS,
+    BUCKETS = 64 * SUB_BUCKETS
+};
+
+typedef struct {
+    unsigned long count;
+    long long total;
+    long long max;
+    unsigned long hist[BUCKETS];
+} histogram_t;
+
+static const char *const stat_names[STAT_COUNT] = {
+    [STAT_DECODE]      = "decode",
+    [STAT_SCALE]       = "scale",
+    [STAT_CACHE_HIT]   = "cache_hit",
+    [STAT_CACHE_MISS]  = "cache_miss",
+    [STAT_CACHE_WRITE] = "cache_write",
+    [STAT_IMG_RENDER]  = "img_render",
+    [STAT_TNS_RENDER]  = "tns_render",
+    [STAT_WIN_DRAW]    = "win_draw",
+    [STAT_X_ROUNDTRIP] = "x_roundtrip"
+};
+
+static const char *const count_names[COUNT_COUNT] = {
+    [COUNT_IMG_CACHE_HIT]      = "image_cache_hit",
+    [COUNT_IMG_CACHE_MISS]     = "image_cache_miss",
+    [COUNT_IMG_CACHE_STALE]    = "image_cache_stale",
+    [COUNT_IMG_CACHE_PREFETCH] = "image_cache_prefetch",
+    [COUNT_IMG_CACHE_EVICT]    = "image_cache_evict",
+    [COUNT_ANIM_SHOWN]         = "anim_shown",
+    [COUNT_ANIM_DROPPED]       = "anim_dropped",
+    [COUNT_ANIM_THROTTLED]     = "anim_throttled",
+    [COUNT_ANIM_NOMINAL_MS]    = "anim_nominal_ms",
+    [COUNT_ANIM_PLAYED_MS]     = "anim_played_ms"
+};
+
+static histogram_t stats[STAT_COUNT];
+static unsigned long counts[COUNT_COUNT];
+static volatile sig_atomic_t dump_requested;
+
+
+long long stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static int bucket(long long ns)
+{
+    int msb = 0;
+
+    if (ns < SUB_BUCKETS)
+        return ns < 0 ? 0 : ns;
+    while (ns >> (msb + 1) != 0)
+        msb++;
+    return (msb - SUB_BITS + 1) << SUB_BITS | (ns >> (msb - SUB_BITS) & (SUB_BUCKETS - 1));
+}
+
+
+/* largest value that falls into bucket b */
+static long long bucket_max(int b)
+{
+    int shift = (b >> SUB_BITS) - 1;
+
+    if (b < SUB_BUCKETS)
+        return b;
+    return ((long long)(SUB_BUCKETS | (b & (SUB_BUCKETS - 1))) << shift) + (1LL << shift) - 1;
+}
+
+
+/*
+ * Records the time since start, as returned by stats_now(), which is also
+ * traced as a span.
+ */
+void stats_add(stat_t s, long long start)
+{
+    histogram_t *h = &stats[s];
+    long long ns = stats_now() - start;
+
+    h->count++;
+    h->total += ns;
+    h->max = MAX(h->max, ns);
+    h->hist[bucket(ns)]++;
+    trace_span(stat_names[s], start, NULL);
+}
+
+
+void stats_count(count_t c, unsigned long n)
+{
+    counts[c] += n;
+}
+
+
+/* upper bound of the given percentile in milliseconds */
+static double percentile(const histogram_t *h, int pct)
+{
+    unsigned long rank = (h->count * pct + 99) / 100, seen = 0;
+
+    for (int b = 0; b < BUCKETS; b++) {
+        if ((seen += h->hist[b]) >= rank && seen > 0)
+            return MIN(bucket_max(b), h->max) / 1e6;
+    }
+    return h->max / 1e6;
+}
+
+
+static void print_text(FILE *f)
+{
+    fprintf(f, "%-12s %8s %12s %10s %10s %10s %10s %10s\n", "stage (ms)",
+            "count", "total", "mean", "p50", "p90", "p99", "max");
+    for (int s = 0; s < STAT_COUNT; s++) {
+        const histogram_t *h = &stats[s];
+        fprintf(f, "%-12s %8lu %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                stat_names[s], h->count, h->total / 1e6,
+                h->count > 0 ? h->total / 1e6 / h->count : 0.0,
+                percentile(h, 50), percentile(h, 90), percentile(h, 99), h->max / 1e6);
+    }
+    fprintf(f, "%-20s %8s\n", "event", "count");
+    for (int c = 0; c < COUNT_COUNT; c++)
+        fprintf(f, "%-20s %8lu\n", count_names[c], counts[c]);
+}
+
+
+static void print_json(FILE *f)
+{
+    fputs("{\n", f);
+    for (int s = 0; s < STAT_COUNT; s++) {
+        const histogram_t *h = &stats[s];
+        fprintf(f, "  \"%s\": { \"count\": %lu, \"total_ms\": %.3f, \"mean_ms\": %.3f, "
+                "\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f },\n",
+                stat_names[s], h->count, h->total / 1e6,
+                h->count > 0 ? h->total / 1e6 / h->count : 0.0,
+                percentile(h, 50), percentile(h, 90), percentile(h, 99), h->max / 1e6);
+    }
+    for (int c = 0; c < COUNT_COUNT; c++) {
+        fprintf(f, "  \"%s\": { \"count\": %lu }%s\n", count_names[c], counts[c],
+                c + 1 < COUNT_COUNT ? "," : "");
+    }
+    fputs("}\n", f);
+}
+
+
+/*
+ * Prints the counters to stderr, and as JSON to the file given to --stats,
+ * which is overwritten by every dump.
+ */
+void stats_dump(void)
+{
+    FILE *f;
+
+    print_text(stderr);
+    if (g_options->stats_file == NULL)
+        return;
+    if ((f = fopen(g_options->stats_file, "w")) == NULL) {
+        error_log(errno, "%s", g_options->stats_file);
+        return;
+    }
+    print_json(f);
+    if (fclose(f) != 0)
+        error_log(errno, "%s", g_options->stats_file);
+}
+
+
+/* signal handler, the dump happens in the next stats_check() */
+void stats_request(int sig)
+{
+    dump_requested = 1;
+}
+
+
+void stats_check(void)
+{
+    if (dump_requested) {
+        dump_requested = 0;
+        stats_dump();
+    }
+}
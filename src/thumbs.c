@@ -21,6 +21,8 @@
 
 #include "cli_options.h"
 #include "image.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 #define INCLUDE_THUMBS_CONFIG
 #include "config.h"
@@ -63,12 +65,36 @@ static char *tns_cache_translate_fp(const char filepath[])
 }
 
 
+static bool tns_cache_init(void)
+{
+    const char *homedir = getenv("XDG_CACHE_HOME");
+    const char *dsuffix = "";
+    if (homedir == NULL || homedir[0] == '\0') {
+        if ((homedir = getenv("HOME")) == NULL)
+            return false;
+        dsuffix = "/.cache";
+    }
+
+    const char *s = "/nsxiv";
+    free(g_cache_dir);
+    free(g_cache_tmpfile);
+    int len = strlen(homedir) + strlen(dsuffix) + strlen(s) + 1;
+    g_cache_dir = emalloc(len);
+    snprintf(g_cache_dir, len, "%s%s%s", homedir, dsuffix, s);
+    g_cache_tmpfile = emalloc(len + sizeof(TMP_NAME));
+    memcpy(g_cache_tmpfile, g_cache_dir, len - 1);
+    g_cache_tmpfile_base = g_cache_tmpfile + len - 1;
+    return true;
+}
+
+
 static Imlib_Image tns_cache_load(const char filepath[], bool *outdated)
 {
     char *cached_file_path;
     struct stat stats_cached_file;
     struct stat stats_requested_file;
     Imlib_Image im = NULL;
+    long long t = stats_now();
 
     if (stat(filepath, &stats_requested_file) < 0)
         return NULL;
@@ -83,6 +109,7 @@ static Imlib_Image tns_cache_load(const char filepath[], bool *outdated)
     }
 
     free(cached_file_path);
+    stats_add(im != NULL ? STAT_CACHE_HIT : STAT_CACHE_MISS, t);
     return im;
 }
 
@@ -93,6 +120,7 @@ static void tns_cache_write(Imlib_Image im, const char filepath[], const bool fo
 {
     char *cfile, *dirend;
     int tmpfd;
+    long long t;
     struct stat cstats, fstats;
     struct utimbuf times;
     Imlib_Load_Error err;
@@ -107,6 +135,7 @@ static void tns_cache_write(Imlib_Image im, const char filepath[], const bool fo
         if (force || stat(cfile, &cstats) < 0 ||
             cstats.st_mtime != fstats.st_mtime)
         {
+            t = stats_now();
             if ((dirend = strrchr(cfile, '/')) != NULL) {
                 *dirend = '\0';
                 if (r_mkdir(cfile) < 0)
@@ -131,6 +160,7 @@ static void tns_cache_write(Imlib_Image im, const char filepath[], const bool fo
             utime(g_cache_tmpfile, &times);
             if (err || rename(g_cache_tmpfile, cfile) < 0)
                 unlink(g_cache_tmpfile);
+            stats_add(STAT_CACHE_WRITE, t);
         }
 end:
         free(cfile);
@@ -205,6 +235,7 @@ void tns_init(ThumbnailState *tns, fileinfo_t *tns_files, const int *thumbnail_c
     tns->thumbs = (thumbnail_count == NULL || *thumbnail_count <= 0)
         ? NULL
         : ecalloc(*thumbnail_count, sizeof(*tns->thumbs));
+    tns->cap = tns->thumbs != NULL ? *thumbnail_count : 0;
 
     tns->files = tns_files;
     tns->cnt = thumbnail_count;
@@ -223,22 +254,36 @@ void tns_init(ThumbnailState *tns, fileinfo_t *tns_files, const int *thumbnail_c
     tns->mark_cm = table;
     transform_mark_color_modifier(tns);
 
-    const char *homedir = getenv("XDG_CACHE_HOME");
-    const char *dsuffix = "";
-    if (homedir == NULL || homedir[0] == '\0') {
-        if ((homedir = getenv("HOME")) == NULL)
-            error_quit(EXIT_FAILURE, 0, "Cache directory not found");
-        dsuffix = "/.cache";
+    if (!tns_cache_init())
+        error_quit(EXIT_FAILURE, 0, "Cache directory not found");
+}
+
+
+/* follows the file list after files got appended to it */
+void tns_grow(ThumbnailState *tns, fileinfo_t *tns_files)
+{
+    tns->files = tns_files;
+    if (*tns->cnt > tns->cap) {
+        int cap = MAX(*tns->cnt, tns->cap * 2);
+        tns->thumbs = erealloc(tns->thumbs, cap * sizeof(*tns->thumbs));
+        memset(tns->thumbs + tns->cap, 0, (cap - tns->cap) * sizeof(*tns->thumbs));
+        tns->cap = cap;
     }
+    tns->dirty = true;
+}
 
-    const char *s = "/nsxiv";
-    free(g_cache_dir);
-    int len = strlen(homedir) + strlen(dsuffix) + strlen(s) + 1;
-    g_cache_dir = emalloc(len);
-    snprintf(g_cache_dir, len, "%s%s%s", homedir, dsuffix, s);
-    g_cache_tmpfile = emalloc(len + sizeof(TMP_NAME));
-    memcpy(g_cache_tmpfile, g_cache_dir, len - 1);
-    g_cache_tmpfile_base = g_cache_tmpfile + len - 1;
+
+/*
+ * Returns the cached thumbnail of file if there is an up to date one, without
+ * needing thumbnail mode to be set up.
+ */
+Imlib_Image tns_cache_peek(const fileinfo_t *file)
+{
+    bool outdated = false;
+
+    if (g_cache_dir == NULL && !tns_cache_init())
+        return NULL;
+    return tns_cache_load(file->path, &outdated);
 }
 
 
@@ -276,6 +321,7 @@ CLEANUP void tns_replace(ThumbnailState *tns, fileinfo_t *tns_files, const int *
         tns->thumbs = ecalloc(*cnt, sizeof(*tns->thumbs));
     else
         tns->thumbs = NULL;
+    tns->cap = tns->thumbs != NULL ? *cnt : 0;
     tns->files = tns_files;
     tns->cnt = cnt;
     tns->next_to_init = tns->next_to_load_in_view = 0;
@@ -297,22 +343,8 @@ CLEANUP void tns_replace(ThumbnailState *tns, fileinfo_t *tns_files, const int *
         transform_mark_color_modifier(tns);
     }
 
-    const char *homedir = getenv("XDG_CACHE_HOME");
-    const char *dsuffix = "";
-    if (homedir == NULL || homedir[0] == '\0') {
-        if ((homedir = getenv("HOME")) == NULL)
-            error_quit(EXIT_FAILURE, 0, "Cache directory not found");
-        dsuffix = "/.cache";
-    }
-
-    const char *s = "/nsxiv";
-    free(g_cache_dir);
-    int len = strlen(homedir) + strlen(dsuffix) + strlen(s) + 1;
-    g_cache_dir = emalloc(len);
-    snprintf(g_cache_dir, len, "%s%s%s", homedir, dsuffix, s);
-    g_cache_tmpfile = emalloc(len + sizeof(TMP_NAME));
-    memcpy(g_cache_tmpfile, g_cache_dir, len - 1);
-    g_cache_tmpfile_base = g_cache_tmpfile + len - 1;
+    if (!tns_cache_init())
+        error_quit(EXIT_FAILURE, 0, "Cache directory not found");
 }
 
 
@@ -333,6 +365,7 @@ static Imlib_Image tns_scale_down(Imlib_Image im, int max_side_size)
     if (scale >= 1.0)
         return im;
 
+    long long t = stats_now();
     imlib_context_set_anti_alias(1);
     im = imlib_create_cropped_scaled_image(
         0, 0, w, h,
@@ -340,13 +373,12 @@ static Imlib_Image tns_scale_down(Imlib_Image im, int max_side_size)
     if (im == NULL)
         error_quit(EXIT_FAILURE, ENOMEM, NULL);
     imlib_free_image_and_decache();
+    stats_add(STAT_SCALE, t);
 
     return im;
 }
 
-// Besides loading thumbnails, this function also advances `next_to_init` and `next_to_load_in_view`
-// Returns true if thumbnail was successfully loaded
-bool tns_load(ThumbnailState *tns, int n, bool force, bool cache_only)
+static bool tns_load_thumb(ThumbnailState *tns, int n, bool force, bool cache_only)
 {
     if (n < 0 || n >= *tns->cnt)
         return false;
@@ -483,6 +515,18 @@ bool tns_load(ThumbnailState *tns, int n, bool force, bool cache_only)
     return true;
 }
 
+// Besides loading thumbnails, this function also advances `next_to_init` and `next_to_load_in_view`
+// Returns true if thumbnail was successfully loaded
+bool tns_load(ThumbnailState *tns, int n, bool force, bool cache_only)
+{
+    long long t = trace_start();
+    bool ok = tns_load_thumb(tns, n, force, cache_only);
+
+    trace_span(cache_only ? "tns_load (cache)" : "tns_load", t,
+               n >= 0 && n < *tns->cnt ? tns->files[n].name : NULL);
+    return ok;
+}
+
 
 void tns_unload(ThumbnailState *tns, int n)
 {
@@ -526,6 +570,7 @@ void tns_render(ThumbnailState *tns)
     if (!tns->dirty)
         return;
 
+    long long t = stats_now();
     win_t *win = tns->win;
     win_clear(win);
     imlib_context_set_drawable(win->buf.pm);
@@ -607,6 +652,7 @@ void tns_render(ThumbnailState *tns)
     }
     tns->dirty = false;
     tns_highlight(tns, *tns->sel, true);
+    stats_add(STAT_TNS_RENDER, t);
 }
 
 
@@ -0,0 +1,552 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tiled.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#if HAVE_LIBTIFF
+#include <tiffio.h>
+#endif
+
+/*
+ * Supported are the uncompressed formats whose rows can be read directly:
+ * binary PGM (P5), binary PPM (P6) and farbfeld, with 8 or 16 bits per sample,
+ * and with libtiff, TIFF files that are stored in tiles, whichever compression
+ * they use. TIFF files stored in strips, JPEG and PNG can't be decoded in
+ * parts and are left to Imlib2.
+ * Every pixel of a lower resolution level is the average of the 2^n x 2^n
+ * pixels of the full image it covers.
+ */
+typedef enum {
+    PIX_GRAY,
+    PIX_RGB,
+    PIX_RGBA
+} pixfmt_t;
+
+struct tiled_image {
+    int fd;
+    int w;
+    int h;
+    pixfmt_t fmt;
+    int depth;    /* bytes per sample */
+    int maxval;
+    off_t offset; /* of the pixel data */
+    int bpp;      /* bytes per pixel */
+#if HAVE_LIBTIFF
+    TIFF *tiff;   /* read through libtiff instead of fd if not NULL */
+    uint32_t tw;  /* size of the tiles of the TIFF file */
+    uint32_t th;
+    uint32_t *raster; /* the TIFF tile last decoded, as libtiff returns it */
+    int rx;
+    int ry;
+#endif
+};
+
+/* per-pixel sums of the full image pixels that make up a region of a level */
+typedef struct {
+    int x0; /* of the region, in full image pixels */
+    int y0;
+    int w;  /* of the region, in level pixels */
+    int h;
+    int step;
+    uint32_t *sum; /* premultiplied a, r, g, b; 255 * 4096^2 still fits */
+} region_t;
+
+typedef struct {
+    const tiled_image_t *timg;
+    int level;
+    int tx;
+    int ty;
+    Imlib_Image im;
+    size_t size;
+    unsigned long used;
+} tile_t;
+
+static struct {
+    tile_t *tiles;
+    int cnt;
+    int cap;
+    size_t size;
+    size_t limit;
+    unsigned long clock;
+} tcache = { .limit = 64 * 1024 * 1024 };
+
+/* reads a decimal number of a netpbm header, skipping whitespace and comments */
+static int pnm_number(FILE *f)
+{
+    int c, n = 0, digits = 0;
+
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(f)) != EOF && c != '\n')
+                ;
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+    }
+    for (; c >= '0' && c <= '9'; c = fgetc(f), digits++) {
+        if (n > (INT32_MAX - 9) / 10)
+            return -1;
+        n = n * 10 + (c - '0');
+    }
+    /* exactly one whitespace character follows the last header field */
+    if (digits == 0 || (c != ' ' && c != '\t' && c != '\r' && c != '\n'))
+        return -1;
+    return n;
+}
+
+
+static uint32_t be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static bool read_header(tiled_image_t *t)
+{
+    unsigned char magic[16];
+    FILE *f;
+    bool ok = false;
+    int fd = dup(t->fd);
+
+    if (fd < 0 || (f = fdopen(fd, "rb")) == NULL) {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (fread(magic, 1, 2, f) != 2)
+        goto end;
+
+    if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+        t->fmt = magic[1] == '5' ? PIX_GRAY : PIX_RGB;
+        t->w = pnm_number(f);
+        t->h = pnm_number(f);
+        t->maxval = pnm_number(f);
+        if (t->w <= 0 || t->h <= 0 || t->maxval <= 0 || t->maxval > 0xFFFF)
+            goto end;
+        t->depth = t->maxval > 0xFF ? 2 : 1;
+        t->offset = ftello(f);
+    } else if (fread(magic + 2, 1, 14, f) == 14 && memcmp(magic, "farbfeld", 8) == 0) {
+        uint32_t w = be32(magic + 8), h = be32(magic + 12);
+        if (w == 0 || h == 0 || w > INT32_MAX || h > INT32_MAX)
+            goto end;
+        t->fmt = PIX_RGBA;
+        t->w = w;
+        t->h = h;
+        t->maxval = 0xFFFF;
+        t->depth = 2;
+        t->offset = 16;
+    } else {
+        goto end;
+    }
+    t->bpp = t->depth * (t->fmt == PIX_GRAY ? 1 : t->fmt == PIX_RGB ? 3 : 4);
+    ok = t->offset > 0;
+end:
+    fclose(f);
+    return ok;
+}
+
+
+#if HAVE_LIBTIFF
+static bool tiff_open(tiled_image_t *t, const char *path)
+{
+    static bool quiet;
+    char emsg[1024];
+    uint32_t w, h;
+    uint16_t extra, *types;
+
+    if (!quiet) {
+        /* errors are reported by nsxiv once Imlib2 fails as well */
+        TIFFSetErrorHandler(NULL);
+        TIFFSetWarningHandler(NULL);
+        quiet = true;
+    }
+    /* the TIFF handle owns the file descriptor from here on */
+    if ((t->tiff = TIFFFdOpen(t->fd, path, "r")) == NULL)
+        return false;
+    t->fd = -1;
+    if (!TIFFIsTiled(t->tiff) || !TIFFRGBAImageOK(t->tiff, emsg) ||
+        !TIFFGetField(t->tiff, TIFFTAG_IMAGEWIDTH, &w) ||
+        !TIFFGetField(t->tiff, TIFFTAG_IMAGELENGTH, &h) ||
+        !TIFFGetField(t->tiff, TIFFTAG_TILEWIDTH, &t->tw) ||
+        !TIFFGetField(t->tiff, TIFFTAG_TILELENGTH, &t->th) ||
+        w == 0 || h == 0 || w > INT32_MAX || h > INT32_MAX ||
+        t->tw == 0 || t->th == 0 || t->tw > 4096 || t->th > 4096)
+    {
+        return false;
+    }
+    t->w = w;
+    t->h = h;
+    t->fmt = TIFFGetFieldDefaulted(t->tiff, TIFFTAG_EXTRASAMPLES, &extra, &types) &&
+             extra > 0 ? PIX_RGBA : PIX_RGB;
+    t->raster = emalloc((size_t)t->tw * t->th * sizeof(*t->raster));
+    t->rx = t->ry = -1;
+    return true;
+}
+#endif
+
+
+static void tiled_free(tiled_image_t *t)
+{
+#if HAVE_LIBTIFF
+    if (t->tiff != NULL)
+        TIFFClose(t->tiff);
+    free(t->raster);
+#endif
+    if (t->fd >= 0)
+        close(t->fd);
+    free(t);
+}
+
+
+/* whether path has the extension of a format that tiled_open() may handle */
+bool tiled_supported(const char *path)
+{
+    static const char *const exts[] = {
+        "pgm", "ppm", "pnm", "ff",
+#if HAVE_LIBTIFF
+        "tif", "tiff",
+#endif
+    };
+    const char *ext = strrchr(path, '.');
+
+    if (ext == NULL || strchr(ext, '/') != NULL)
+        return false;
+    for (unsigned int i = 0; i < ARRLEN(exts); i++) {
+        if (strcasecmp(ext + 1, exts[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * Opens path as a tiled image, if it is in a supported format and has at
+ * least min_pixels pixels, otherwise it's left to Imlib2.
+ */
+tiled_image_t *tiled_open(const char *path, long long min_pixels)
+{
+    tiled_image_t *t = ecalloc(1, sizeof(*t));
+    unsigned char magic[4];
+    bool ok;
+
+    if ((t->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        free(t);
+        return NULL;
+    }
+    if (pread(t->fd, magic, sizeof(magic), 0) != sizeof(magic)) {
+        ok = false;
+    } else if ((magic[0] == 'I' && magic[1] == 'I') || (magic[0] == 'M' && magic[1] == 'M')) {
+#if HAVE_LIBTIFF
+        ok = tiff_open(t, path);
+#else
+        ok = false;
+#endif
+    } else {
+        ok = read_header(t);
+    }
+    if (!ok || (long long)t->w * t->h < min_pixels) {
+        tiled_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+
+static void tile_drop(int i)
+{
+    tile_t *tile = &tcache.tiles[i];
+
+    imlib_context_set_image(tile->im);
+    imlib_free_image();
+    tcache.size -= tile->size;
+    *tile = tcache.tiles[--tcache.cnt];
+}
+
+
+void tiled_close(tiled_image_t *t)
+{
+    if (t == NULL)
+        return;
+    for (int i = tcache.cnt - 1; i >= 0; i--) {
+        if (tcache.tiles[i].timg == t)
+            tile_drop(i);
+    }
+    tiled_free(t);
+}
+
+
+void tiled_get_size(const tiled_image_t *t, int *w, int *h)
+{
+    *w = t->w;
+    *h = t->h;
+}
+
+
+bool tiled_has_alpha(const tiled_image_t *t)
+{
+    return t->fmt == PIX_RGBA;
+}
+
+
+/* pixel at p of a raw format as premultiplied ARGB */
+static uint32_t sample(const tiled_image_t *t, const unsigned char *p)
+{
+    uint32_t c[4] = { 0, 0, 0, 0xFF };
+    int n = t->bpp / t->depth;
+
+    for (int i = 0; i < n; i++, p += t->depth) {
+        uint32_t v = t->depth == 2 ? (uint32_t)p[0] << 8 | p[1] : p[0];
+        c[i] = t->maxval == 0xFF ? v : MIN(v, (uint32_t)t->maxval) * 0xFF / t->maxval;
+    }
+    if (t->fmt == PIX_GRAY)
+        c[1] = c[2] = c[0];
+    if (c[3] != 0xFF) {
+        for (int i = 0; i < 3; i++)
+            c[i] = (c[i] * c[3] + 127) / 255;
+    }
+    return c[3] << 24 | c[0] << 16 | c[1] << 8 | c[2];
+}
+
+
+/* adds n premultiplied ARGB pixels of row y of the full image, from column x on */
+static void region_add(region_t *r, int x, int y, const uint32_t *px, int n)
+{
+    uint32_t *sum = r->sum + (size_t)((y - r->y0) / r->step) * r->w * 4;
+    int ox = (x - r->x0) / r->step, left = r->step - (x - r->x0) % r->step;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t *s = sum + (size_t)ox * 4;
+        s[0] += px[i] >> 24;
+        s[1] += px[i] >> 16 & 0xFF;
+        s[2] += px[i] >> 8 & 0xFF;
+        s[3] += px[i] & 0xFF;
+        if (--left == 0) {
+            ox++;
+            left = r->step;
+        }
+    }
+}
+
+
+/* the averages of the sums as an image */
+static Imlib_Image region_image(const tiled_image_t *t, const region_t *r)
+{
+    Imlib_Image im;
+    uint32_t *data = emalloc((size_t)r->w * r->h * sizeof(*data));
+
+    for (int y = 0; y < r->h; y++) {
+        int ch = MIN(r->step, t->h - (r->y0 + y * r->step));
+        for (int x = 0; x < r->w; x++) {
+            const uint32_t *s = r->sum + ((size_t)y * r->w + x) * 4;
+            uint32_t n = (uint32_t)MIN(r->step, t->w - (r->x0 + x * r->step)) * ch;
+            uint32_t c[4];
+
+            for (int i = 0; i < 4; i++)
+                c[i] = (s[i] + n / 2) / n;
+            /* Imlib2 wants straight alpha */
+            if (c[0] != 0xFF && c[0] != 0) {
+                for (int i = 1; i < 4; i++)
+                    c[i] = MIN((c[i] * 255 + c[0] / 2) / c[0], 0xFF);
+            }
+            data[(size_t)y * r->w + x] = c[0] << 24 | c[1] << 16 | c[2] << 8 | c[3];
+        }
+    }
+    if ((im = imlib_create_image_using_copied_data(r->w, r->h, data)) != NULL) {
+        imlib_context_set_image(im);
+        imlib_image_set_has_alpha(t->fmt == PIX_RGBA);
+    }
+    free(data);
+    return im;
+}
+
+
+static void read_raw(const tiled_image_t *t, region_t *r)
+{
+    int x1 = MIN(t->w, r->x0 + r->w * r->step), y1 = MIN(t->h, r->y0 + r->h * r->step);
+    int n = x1 - r->x0;
+    size_t span = (size_t)n * t->bpp;
+    unsigned char *row = emalloc(span);
+    uint32_t *px = emalloc((size_t)n * sizeof(*px));
+
+    for (int y = r->y0; y < y1; y++) {
+        off_t off = t->offset + ((off_t)y * t->w + r->x0) * t->bpp;
+        size_t done = 0;
+        while (done < span) {
+            ssize_t len = pread(t->fd, row + done, span - done, off + done);
+            if (len <= 0) {
+                if (len < 0 && errno == EINTR)
+                    continue;
+                /* truncated file, the rest stays black */
+                memset(row + done, 0, span - done);
+                break;
+            }
+            done += len;
+        }
+        for (int x = 0; x < n; x++)
+            px[x] = sample(t, row + (size_t)x * t->bpp);
+        region_add(r, r->x0, y, px, n);
+    }
+    free(px);
+    free(row);
+}
+
+
+#if HAVE_LIBTIFF
+static void read_tiff(tiled_image_t *t, region_t *r)
+{
+    int x1 = MIN(t->w, r->x0 + r->w * r->step), y1 = MIN(t->h, r->y0 + r->h * r->step);
+    int tw = t->tw, th = t->th;
+    uint32_t *px = emalloc(tw * sizeof(*px));
+
+    for (int ty = r->y0 / th * th; ty < y1; ty += th) {
+        for (int tx = r->x0 / tw * tw; tx < x1; tx += tw) {
+            int sx = MAX(tx, r->x0), ex = MIN(tx + tw, x1);
+
+            if ((tx != t->rx || ty != t->ry) && !TIFFReadRGBATile(t->tiff, tx, ty, t->raster)) {
+                /* undecodable tiles stay black */
+                memset(t->raster, 0, (size_t)tw * th * sizeof(*t->raster));
+            }
+            t->rx = tx;
+            t->ry = ty;
+            for (int y = MAX(ty, r->y0); y < MIN(ty + th, y1); y++) {
+                /* the rows of the raster are bottom-up */
+                const uint32_t *abgr = t->raster + (size_t)(th - 1 - (y - ty)) * tw + (sx - tx);
+                for (int x = 0; x < ex - sx; x++) {
+                    px[x] = (uint32_t)TIFFGetA(abgr[x]) << 24 | TIFFGetR(abgr[x]) << 16 |
+                            TIFFGetG(abgr[x]) << 8 | TIFFGetB(abgr[x]);
+                }
+                region_add(r, sx, y, px, ex - sx);
+            }
+        }
+    }
+    free(px);
+}
+#endif
+
+
+/*
+ * Reads the w x h pixels starting at x0, y0 of the image at 1/step of its
+ * resolution, i.e. pixel (x, y) is the average of the step x step pixels from
+ * (x0 + x * step, y0 + y * step) on of the full image.
+ */
+static Imlib_Image read_region(tiled_image_t *t, int x0, int y0, int w, int h, int step)
+{
+    region_t r = { .x0 = x0, .y0 = y0, .w = w, .h = h, .step = step };
+    Imlib_Image im;
+
+    r.sum = ecalloc((size_t)w * h * 4, sizeof(*r.sum));
+#if HAVE_LIBTIFF
+    if (t->tiff != NULL)
+        read_tiff(t, &r);
+    else
+        read_raw(t, &r);
+#else
+    read_raw(t, &r);
+#endif
+    im = region_image(t, &r);
+    free(r.sum);
+    return im;
+}
+
+
+static void tcache_reserve(size_t size)
+{
+    while (tcache.cnt > 0 && tcache.size + size > tcache.limit) {
+        int lru = 0;
+        for (int i = 1; i < tcache.cnt; i++) {
+            if (tcache.tiles[i].used < tcache.tiles[lru].used)
+                lru = i;
+        }
+        tile_drop(lru);
+    }
+    if (tcache.cnt == tcache.cap) {
+        tcache.cap = MAX(tcache.cap * 2, 64);
+        tcache.tiles = erealloc(tcache.tiles, tcache.cap * sizeof(*tcache.tiles));
+    }
+}
+
+
+/*
+ * Returns tile (tx, ty) of the given level, which stays valid until the next
+ * call. Edge tiles are smaller than TILE_SIZE.
+ */
+Imlib_Image tiled_get_tile(tiled_image_t *t, int level, int tx, int ty)
+{
+    int step = 1 << level;
+    int x0 = tx * TILE_SIZE * step, y0 = ty * TILE_SIZE * step;
+    int w, h;
+    tile_t *tile;
+    Imlib_Image im;
+
+    for (int i = 0; i < tcache.cnt; i++) {
+        tile = &tcache.tiles[i];
+        if (tile->timg == t && tile->level == level && tile->tx == tx && tile->ty == ty) {
+            tile->used = ++tcache.clock;
+            return tile->im;
+        }
+    }
+    if (x0 >= t->w || y0 >= t->h)
+        return NULL;
+
+    w = MIN(TILE_SIZE, (t->w - x0 + step - 1) / step);
+    h = MIN(TILE_SIZE, (t->h - y0 + step - 1) / step);
+    if ((im = read_region(t, x0, y0, w, h, step)) == NULL)
+        return NULL;
+
+    tcache_reserve((size_t)w * h * sizeof(uint32_t));
+    tile = &tcache.tiles[tcache.cnt++];
+    tile->timg = t;
+    tile->level = level;
+    tile->tx = tx;
+    tile->ty = ty;
+    tile->im = im;
+    tile->size = (size_t)w * h * sizeof(uint32_t);
+    tile->used = ++tcache.clock;
+    tcache.size += tile->size;
+    return im;
+}
+
+
+/* the whole image at the first level that is at most max_side pixels big */
+Imlib_Image tiled_overview(tiled_image_t *t, int max_side)
+{
+    int step = 1;
+
+    while (t->w / step > max_side || t->h / step > max_side)
+        step *= 2;
+    return read_region(t, 0, 0, (t->w + step - 1) / step, (t->h + step - 1) / step, step);
+}
+
+
+void tiled_set_cache_size(size_t size)
+{
+    tcache.limit = size;
+    tcache_reserve(0);
+}
@@ -0,0 +1,244 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nsxiv.h"
+#include "trace.h"
+#include "util.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+
+/*
+ * Pending timeouts are kept in a binary min-heap ordered by their deadline on
+ * the monotonic clock, so clock jumps don't affect them. Any function can be
+ * used as a handler, each one has at most one pending timeout.
+ *
+ * With timerfd the earliest deadline is armed on a file descriptor which is
+ * polled together with the others in run(); it is only re-armed when the
+ * earliest deadline changes. Otherwise run() has to pass the time left until
+ * then as the poll(2) timeout.
+ */
+typedef struct {
+    timeout_f handler;
+    long long when; /* nanoseconds */
+} timeout_t;
+
+static struct {
+    timeout_t *heap;
+    int cnt;
+    int cap;
+    int fd;
+    long long armed; /* deadline the timerfd is set to, 0 if disarmed */
+} timers = { .fd = -1 };
+
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static void heap_swap(int i, int j)
+{
+    timeout_t t = timers.heap[i];
+
+    timers.heap[i] = timers.heap[j];
+    timers.heap[j] = t;
+}
+
+
+static void sift_up(int i)
+{
+    for (; i > 0 && timers.heap[i].when < timers.heap[(i - 1) / 2].when; i = (i - 1) / 2)
+        heap_swap(i, (i - 1) / 2);
+}
+
+
+static void sift_down(int i)
+{
+    while (true) {
+        int min = i, l = 2 * i + 1, r = l + 1;
+
+        if (l < timers.cnt && timers.heap[l].when < timers.heap[min].when)
+            min = l;
+        if (r < timers.cnt && timers.heap[r].when < timers.heap[min].when)
+            min = r;
+        if (min == i)
+            break;
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+
+static int heap_find(timeout_f handler)
+{
+    for (int i = 0; i < timers.cnt; i++) {
+        if (timers.heap[i].handler == handler)
+            return i;
+    }
+    return -1;
+}
+
+
+static void heap_remove(int i)
+{
+    timers.heap[i] = timers.heap[--timers.cnt];
+    if (i < timers.cnt) {
+        sift_up(i);
+        sift_down(i);
+    }
+}
+
+
+static void arm(long long when)
+{
+#if HAVE_TIMERFD
+    struct itimerspec its = { 0 };
+
+    if (timers.fd < 0 || when == timers.armed)
+        return;
+    /* a zero it_value disarms the timer, setting it resets its readiness */
+    its.it_value.tv_sec = when / 1000000000LL;
+    its.it_value.tv_nsec = when % 1000000000LL;
+    if (timerfd_settime(timers.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        error_log(errno, "timerfd_settime");
+        close(timers.fd);
+        timers.fd = -1;
+    }
+    timers.armed = when;
+#else
+    (void)when;
+#endif
+}
+
+
+/*
+ * Returns the file descriptor that becomes readable when the next timeout is
+ * due, or -1 if there is none and the poll(2) timeout has to be used.
+ */
+int timeout_fd(void)
+{
+#if HAVE_TIMERFD
+    static bool tried;
+
+    if (!tried) {
+        tried = true;
+        if ((timers.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+            error_log(errno, "timerfd_create");
+    }
+#endif
+    return timers.fd;
+}
+
+
+void set_timeout(timeout_f handler, int time, bool overwrite)
+{
+    int i = heap_find(handler);
+
+    if (i >= 0 && !overwrite)
+        return;
+    if (i < 0) {
+        if (timers.cnt == timers.cap) {
+            timers.cap = MAX(timers.cap * 2, 8);
+            timers.heap = erealloc(timers.heap, timers.cap * sizeof(*timers.heap));
+        }
+        i = timers.cnt++;
+        timers.heap[i].handler = handler;
+    }
+    timers.heap[i].when = now_ns() + time * 1000000LL;
+    sift_up(i);
+    sift_down(i);
+}
+
+
+void reset_timeout(timeout_f handler)
+{
+    int i = heap_find(handler);
+
+    if (i >= 0)
+        heap_remove(i);
+}
+
+
+bool timeout_active(timeout_f handler)
+{
+    return heap_find(handler) >= 0;
+}
+
+
+/*
+ * Calls the handlers of all due timeouts. Returns false if no timeout is left
+ * pending, otherwise *t is set to the poll(2) timeout in milliseconds, which
+ * is -1 if the timerfd takes care of the wakeup.
+ */
+bool check_timeouts(int *t)
+{
+    long long now, left;
+
+    if (timers.cnt == 0) {
+        arm(0);
+        return false;
+    }
+    now = now_ns();
+    while (timers.cnt > 0 && timers.heap[0].when <= now) {
+        timeout_f handler = timers.heap[0].handler;
+        long long start = trace_start();
+
+        heap_remove(0);
+        /* timeouts the handler sets are at least due after now */
+        handler();
+        trace_span("timeout", start, NULL);
+    }
+    if (timers.cnt == 0) {
+        arm(0);
+        return false;
+    }
+    if (timeout_fd() >= 0) {
+        arm(timers.heap[0].when);
+        if (timers.fd >= 0) {
+            *t = -1;
+            return true;
+        }
+    }
+    /* round up, waking up early would only spin until the deadline */
+    left = timers.heap[0].when - now_ns();
+    *t = left <= 0 ? 0 : MIN((left + 999999) / 1000000, INT_MAX);
+    return true;
+}
+
+
+void timeout_cleanup(void)
+{
+    free(timers.heap);
+    timers.heap = NULL;
+    timers.cnt = timers.cap = 0;
+    if (timers.fd >= 0)
+        close(timers.fd);
+    timers.fd = -1;
+}
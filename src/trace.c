@@ -0,0 +1,152 @@
+/* Copyright 2023 nsxiv contributors
+ *
+ * This file is a part of nsxiv.
+ *
+ * nsxiv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * nsxiv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include "nsxiv.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The events are written as they happen in the JSON array format, whose
+ * closing bracket is optional, so the trace of a crashed nsxiv still loads.
+ * Spans of the main loop are complete ("X") events on the thread of nsxiv,
+ * those of spawned processes on a thread of their own, named after them.
+ */
+static struct {
+    FILE *f;
+    pid_t pid;
+    const char *sep;
+} trace;
+
+
+static void put_string(const char *s)
+{
+    putc('"', trace.f);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(trace.f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(trace.f, "\\u%04x", c);
+        else
+            putc(c, trace.f);
+    }
+    putc('"', trace.f);
+}
+
+
+static void put_metadata(const char *type, pid_t tid, const char *name)
+{
+    fprintf(trace.f, "%s{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+            trace.sep, type, (int)trace.pid, (int)tid);
+    put_string(name);
+    fputs("}}", trace.f);
+    trace.sep = ",\n";
+}
+
+
+static void put_span(const char *name, pid_t tid, long long start, const char *detail)
+{
+    struct timespec ts;
+    long long now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    fprintf(trace.f, "%s{\"name\":", trace.sep);
+    put_string(name);
+    fprintf(trace.f, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+            start / 1e3, (now - start) / 1e3, (int)trace.pid, (int)tid);
+    if (detail != NULL) {
+        fputs(",\"args\":{\"detail\":", trace.f);
+        put_string(detail);
+        putc('}', trace.f);
+    }
+    putc('}', trace.f);
+    trace.sep = ",\n";
+}
+
+
+void trace_init(void)
+{
+    const char *path = getenv("NSXIV_TRACE");
+    int fd;
+
+    if (path == NULL || *path == '\0')
+        return;
+    /* not to be inherited by the spawned helpers */
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0 || (trace.f = fdopen(fd, "w")) == NULL) {
+        error_log(errno, "%s", path);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    trace.pid = getpid();
+    trace.sep = "";
+    fputs("[\n", trace.f);
+    put_metadata("process_name", trace.pid, progname);
+    put_metadata("thread_name", trace.pid, "main");
+}
+
+
+void trace_close(void)
+{
+    if (trace.f == NULL)
+        return;
+    fputs("\n]\n", trace.f);
+    if (fclose(trace.f) != 0)
+        error_log(errno, "NSXIV_TRACE");
+    trace.f = NULL;
+}
+
+
+/* current time to pass as start to trace_span(), 0 if tracing is off */
+long long trace_start(void)
+{
+    struct timespec ts;
+
+    if (trace.f == NULL)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/* records a span from start until now, detail is shown as its argument */
+void trace_span(const char *name, long long start, const char *detail)
+{
+    if (trace.f != NULL && start != 0)
+        put_span(name, trace.pid, start, detail);
+}
+
+
+/* records the lifetime of a spawned process on a track of its own */
+void trace_process(const char *cmd, pid_t pid, long long start)
+{
+    if (trace.f == NULL || start == 0 || pid <= 0)
+        return;
+    put_metadata("thread_name", pid, cmd);
+    put_span(cmd, pid, start, NULL);
+}
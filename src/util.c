@@ -17,6 +17,8 @@
  * along with nsxiv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _DEFAULT_SOURCE /* DT_* constants */
+
 #include "util.h"
 #include "cli_options.h"
 
@@ -75,6 +77,45 @@ char *estrdup(const char *s)
 }
 
 
+enum { ARENA_BLOCK_SIZE = 64 * 1024 };
+
+struct arena_block {
+    arena_block_t *next;
+    size_t cap;
+    char data[];
+};
+
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len)
+{
+    arena_block_t *b = arena->head;
+
+    if (b == NULL || b->cap - arena->used <= len) {
+        size_t cap = MAX(len + 1, (size_t)ARENA_BLOCK_SIZE);
+        b = emalloc(sizeof(*b) + cap);
+        b->cap = cap;
+        b->next = arena->head;
+        arena->head = b;
+        arena->used = 0;
+    }
+    char *p = memcpy(b->data + arena->used, s, len);
+    p[len] = '\0';
+    arena->used += len + 1;
+    return p;
+}
+
+
+void arena_free(arena_t *arena)
+{
+    while (arena->head != NULL) {
+        arena_block_t *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->used = 0;
+}
+
+
 static void log_error(int err_num, const char *msg_fmt, va_list args) {
     fflush(stdout);
     fprintf(stderr, "%s: ", progname);
@@ -174,18 +215,29 @@ char *r_readdir(r_dir_t *rdir, bool skip_dotfiles)
                     continue;
             }
 
+            bool is_dir;
+#ifdef DT_DIR
+            if (dentry->d_type == DT_DIR || dentry->d_type == DT_REG) {
+                is_dir = dentry->d_type == DT_DIR;
+            } else
+#endif
+            {
+                /* symlinks and filesystems without d_type */
+                struct stat fstats;
+                if (fstatat(dirfd(rdir->dir), dentry->d_name, &fstats, 0) < 0)
+                    continue;
+                is_dir = S_ISDIR(fstats.st_mode);
+            }
+            if (is_dir && !rdir->recursive)
+                continue;
+
             size_t len = strlen(rdir->name) + strlen(dentry->d_name) + 2;
             char *filename = emalloc(len);
             snprintf(filename, len, "%s%s%s", rdir->name,
                      rdir->name[strlen(rdir->name) - 1] == '/' ? "" : "/",
                      dentry->d_name);
 
-            struct stat fstats;
-            if (stat(filename, &fstats) < 0) {
-                free(filename);
-                continue;
-            }
-            if (S_ISDIR(fstats.st_mode)) {
+            if (is_dir) {
                 /* put subdirectory on the stack */
                 if (rdir->stlen == rdir->stcap) {
                     rdir->stcap *= 2;
@@ -19,6 +19,7 @@
 
 #include "cli_options.h"
 #include "icon_data.h"
+#include "stats.h"
 #include "util.h"
 #include "window.h"
 #define INCLUDE_WINDOW_CONFIG
@@ -269,7 +270,8 @@ void win_open(win_t *win)
 
     XSelectInput(e->dpy, win->xwin,
                  ButtonReleaseMask | ButtonPressMask | KeyPressMask |
-                 PointerMotionMask | StructureNotifyMask);
+                 PointerMotionMask | StructureNotifyMask |
+                 VisibilityChangeMask | FocusChangeMask);
 
     for (i = 0; i < (int)ARRLEN(cursors); i++) {
         if (i != CURSOR_NONE)
@@ -282,6 +284,8 @@ void win_open(win_t *win)
     *cnone = XCreatePixmapCursor(e->dpy, none, none, &col, &col, 0, 0);
 
     gc = XCreateGC(e->dpy, win->xwin, 0, None);
+    /* win_shift() copies within the buffer, it is never obscured */
+    XSetGraphicsExposures(e->dpy, gc, False);
 
     n = icons[ARRLEN(icons) - 1].size;
     icon_data = emalloc((n * n + 2) * sizeof(*icon_data));
@@ -398,10 +402,35 @@ void win_toggle_bar(win_t *win)
     }
 }
 
+/* copies the buffer content below or above the bar away if win_save() asked for it */
+static void win_save_now(win_t *win)
+{
+    win_env_t *e = &win->env;
+    int top = win->bar.top ? win->bar.h : 0;
+
+    if (!win->buf.save || win->w != win->buf.save_w || win->h != win->buf.save_h ||
+        top != win->buf.save_top)
+    {
+        win->buf.save = false;
+        return;
+    }
+    if (win->w > win->buf.frame_w || win->h > win->buf.frame_h) {
+        if (win->buf.frame != None)
+            XFreePixmap(e->dpy, win->buf.frame);
+        win->buf.frame_w = MAX(win->buf.frame_w, win->w);
+        win->buf.frame_h = MAX(win->buf.frame_h, win->h);
+        win->buf.frame = XCreatePixmap(e->dpy, win->xwin, win->buf.frame_w, win->buf.frame_h, e->depth);
+    }
+    XCopyArea(e->dpy, win->buf.pm, win->buf.frame, gc, 0, top, win->w, win->h, 0, 0);
+    win->buf.frame_gen = win->buf.gen;
+    win->buf.save = false;
+}
+
 void win_clear(win_t *win)
 {
     win_env_t *e = &win->env;
 
+    win_save_now(win);
     if (win->w > win->buf.w || win->h + win->bar.h > win->buf.h) {
         XFreePixmap(e->dpy, win->buf.pm);
         win->buf.w = MAX(win->buf.w, win->w);
@@ -411,6 +440,85 @@ void win_clear(win_t *win)
     }
     XSetForeground(e->dpy, gc, win->win_bg.pixel);
     XFillRectangle(e->dpy, win->buf.pm, gc, 0, 0, win->buf.w, win->buf.h);
+    win->buf.gen++;
+}
+
+/* moves the buffer content below or above the bar by dx, dy and clears the
+ * uncovered area */
+void win_shift(win_t *win, int dx, int dy)
+{
+    win_env_t *e = &win->env;
+    int top = win->bar.top ? win->bar.h : 0;
+    int w = win->w, h = win->h;
+
+    if (ABS(dx) >= w || ABS(dy) >= h) {
+        win_clear(win);
+        return;
+    }
+    XCopyArea(e->dpy, win->buf.pm, win->buf.pm, gc, MAX(-dx, 0), top + MAX(-dy, 0),
+              w - ABS(dx), h - ABS(dy), MAX(dx, 0), top + MAX(dy, 0));
+    XSetForeground(e->dpy, gc, win->win_bg.pixel);
+    if (dx != 0)
+        XFillRectangle(e->dpy, win->buf.pm, gc, dx > 0 ? 0 : w + dx, top, ABS(dx), h);
+    if (dy != 0)
+        XFillRectangle(e->dpy, win->buf.pm, gc, 0, dy > 0 ? top : top + h + dy, w, ABS(dy));
+}
+
+/*
+ * Asks win_clear() to keep a copy of the buffer content below or above the
+ * bar, as it is by then, before clearing it for something else. Only the
+ * last generation of the buffer that got saved can be put back by
+ * win_restore(), and only at the same window geometry.
+ */
+void win_save(win_t *win)
+{
+    win->buf.save = true;
+    win->buf.save_w = win->w;
+    win->buf.save_h = win->h;
+    win->buf.save_top = win->bar.top ? win->bar.h : 0;
+}
+
+/* tells win_clear() that the buffer content needn't be kept */
+void win_unsave(win_t *win)
+{
+    win->buf.save = false;
+}
+
+bool win_restore(win_t *win, unsigned long gen)
+{
+    win_env_t *e = &win->env;
+
+    if (win->buf.frame == None || gen != win->buf.frame_gen ||
+        win->w > win->buf.frame_w || win->h > win->buf.frame_h)
+    {
+        return false;
+    }
+    XCopyArea(e->dpy, win->buf.frame, win->buf.pm, gc, 0, 0, win->w, win->h,
+              0, win->bar.top ? win->bar.h : 0);
+    return true;
+}
+
+/* a new pixmap with the buffer content below or above the bar */
+Pixmap win_snapshot(win_t *win)
+{
+    win_env_t *e = &win->env;
+    Pixmap pm = XCreatePixmap(e->dpy, win->xwin, win->w, win->h, e->depth);
+
+    XCopyArea(e->dpy, win->buf.pm, pm, gc, 0, win->bar.top ? win->bar.h : 0,
+              win->w, win->h, 0, 0);
+    return pm;
+}
+
+/* puts back a snapshot taken at the current window size */
+void win_put_snapshot(win_t *win, Pixmap pm)
+{
+    XCopyArea(win->env.dpy, pm, win->buf.pm, gc, 0, 0, win->w, win->h,
+              0, win->bar.top ? win->bar.h : 0);
+}
+
+void win_free_snapshot(win_t *win, Pixmap pm)
+{
+    XFreePixmap(win->env.dpy, pm);
 }
 
 #if HAVE_LIBFONTS
@@ -497,12 +605,15 @@ static void win_draw_bar(win_t *win)
 
 void win_draw(win_t *win)
 {
+    long long t = stats_now();
+
     if (win->bar.h > 0)
         win_draw_bar(win);
 
     XSetWindowBackgroundPixmap(win->env.dpy, win->xwin, win->buf.pm);
     XClearWindow(win->env.dpy, win->xwin);
     XFlush(win->env.dpy);
+    stats_add(STAT_WIN_DRAW, t);
 }
 
 void win_draw_rect(win_t *window, int x, int y, int w, int h, bool fill, int line_width,
@@ -537,7 +648,9 @@ void win_cursor_pos(win_t *win, int *x, int *y)
     int i;
     unsigned int ui;
     Window w;
+    long long t = stats_now();
 
     if (!XQueryPointer(win->env.dpy, win->xwin, &w, &w, &i, &i, x, y, &ui))
         *x = *y = 0;
+    stats_add(STAT_X_ROUNDTRIP, t);
 }